@@ -1,16 +1,195 @@
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ADLER32_X86_KERNELS
+#include <immintrin.h>
+#endif
+
 #include "adler32.h"
 
 constexpr uint32_t MOD_ADLER = 65521;
+// largest n such that 255n(n+1)/2 + (n+1)(MOD_ADLER-1) fits in 32 bits, so modulo can be postponed for n bytes
+constexpr uint32_t NMAX = 5552;
+
+using Kernel = uint32_t (*)(uint32_t a, uint32_t b, const unsigned char* data, size_t size);
+
+static uint32_t Adler32Scalar(uint32_t a, uint32_t b, const unsigned char* data, size_t size)
+{
+    while (size > 0) {
+        const auto chunk = std::min<size_t>(size, NMAX);
+        size -= chunk;
+        for (auto end = data + chunk; data != end; ++data) {
+            a += *data;
+            b += a;
+        }
+        a %= MOD_ADLER;
+        b %= MOD_ADLER;
+    }
+
+    return (b << 16) | a;
+}
+
+#ifdef ADLER32_X86_KERNELS
+// Both vector kernels work on 32 byte blocks: 'a' is a plain byte sum (psadbw), weighted sum for 'b' is done with
+// pmaddubsw using weights 32..1, and contribution of 'a' accumulated before each block is gathered in 'ps' and
+// multiplied by block size at the end. At most NMAX / 32 blocks are summed before reducing, so no lane overflows.
+constexpr size_t BLOCK_SIZE = 32;
+
+__attribute__((target("avx2"))) static uint32_t HorizontalSum(__m256i v)
+{
+    auto sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+}
+
+__attribute__((target("avx2"))) static uint32_t Adler32Avx2(uint32_t a, uint32_t b, const unsigned char* data, size_t size)
+{
+    const auto zero = _mm256_setzero_si256();
+    const auto ones = _mm256_set1_epi16(1);
+    const auto weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+        16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+
+    auto blocks = size / BLOCK_SIZE;
+    size -= blocks * BLOCK_SIZE;
+    while (blocks > 0) {
+        auto n = std::min<size_t>(blocks, NMAX / BLOCK_SIZE);
+        blocks -= n;
+
+        auto vps = _mm256_setr_epi32(static_cast<int>(a * n), 0, 0, 0, 0, 0, 0, 0);
+        auto vb = _mm256_setr_epi32(static_cast<int>(b), 0, 0, 0, 0, 0, 0, 0);
+        auto va = zero;
+        do {
+            const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+            vps = _mm256_add_epi32(vps, va);
+            va = _mm256_add_epi32(va, _mm256_sad_epu8(bytes, zero));
+            vb = _mm256_add_epi32(vb, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weights), ones));
+            data += BLOCK_SIZE;
+        } while (--n);
+        vb = _mm256_add_epi32(vb, _mm256_slli_epi32(vps, 5));
+
+        a = (a + HorizontalSum(va)) % MOD_ADLER;
+        b = HorizontalSum(vb) % MOD_ADLER;
+    }
+
+    return Adler32Scalar(a, b, data, size);
+}
+
+__attribute__((target("sse4.1"))) static uint32_t HorizontalSum(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(v));
+}
+
+__attribute__((target("sse4.1"))) static uint32_t Adler32Sse41(uint32_t a, uint32_t b, const unsigned char* data, size_t size)
+{
+    const auto zero = _mm_setzero_si128();
+    const auto ones = _mm_set1_epi16(1);
+    const auto weightsHigh = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+    const auto weightsLow = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+
+    auto blocks = size / BLOCK_SIZE;
+    size -= blocks * BLOCK_SIZE;
+    while (blocks > 0) {
+        auto n = std::min<size_t>(blocks, NMAX / BLOCK_SIZE);
+        blocks -= n;
+
+        auto vps = _mm_setr_epi32(static_cast<int>(a * n), 0, 0, 0);
+        auto vb = _mm_setr_epi32(static_cast<int>(b), 0, 0, 0);
+        auto va = zero;
+        do {
+            const auto bytes1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+            const auto bytes2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+            vps = _mm_add_epi32(vps, va);
+            va = _mm_add_epi32(va, _mm_sad_epu8(bytes1, zero));
+            vb = _mm_add_epi32(vb, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, weightsHigh), ones));
+            va = _mm_add_epi32(va, _mm_sad_epu8(bytes2, zero));
+            vb = _mm_add_epi32(vb, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, weightsLow), ones));
+            data += BLOCK_SIZE;
+        } while (--n);
+        vb = _mm_add_epi32(vb, _mm_slli_epi32(vps, 5));
 
-uint32_t adler32(std::string_view data)
+        a = (a + HorizontalSum(va)) % MOD_ADLER;
+        b = HorizontalSum(vb) % MOD_ADLER;
+    }
+
+    return Adler32Scalar(a, b, data, size);
+}
+#endif
+
+bool filediff::adler32KernelSupported(Adler32Kernel kernel) noexcept
+{
+    switch (kernel) {
+    case Adler32Kernel::SCALAR:
+        return true;
+#ifdef ADLER32_X86_KERNELS
+    case Adler32Kernel::SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case Adler32Kernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+static Kernel SelectKernel(filediff::Adler32Kernel kernel)
 {
-    auto a = 1, b = 0;
-    for (auto elem : data) {
-        a += elem;
-        b += a;
+    switch (kernel) {
+#ifdef ADLER32_X86_KERNELS
+    case filediff::Adler32Kernel::AVX2:
+        return Adler32Avx2;
+    case filediff::Adler32Kernel::SSE41:
+        return Adler32Sse41;
+#endif
+    default:
+        return Adler32Scalar;
     }
-    a %= MOD_ADLER;
-    b %= MOD_ADLER;
+}
 
-    return (b * 65536) + a;
+static Kernel DetectKernel()
+{
+    for (auto kernel : { filediff::Adler32Kernel::AVX2, filediff::Adler32Kernel::SSE41 }) {
+        if (filediff::adler32KernelSupported(kernel)) {
+            return SelectKernel(kernel);
+        }
+    }
+    return Adler32Scalar;
+}
+
+uint32_t filediff::adler32(std::string_view data)
+{
+    static const auto kernel = DetectKernel();
+    return kernel(1, 0, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+}
+
+uint32_t filediff::adler32(std::string_view data, Adler32Kernel kernel)
+{
+    if (!adler32KernelSupported(kernel)) {
+        throw std::runtime_error("Adler-32 kernel is not supported by this CPU!");
+    }
+    return SelectKernel(kernel)(1, 0, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+}
+
+filediff::RollingAdler32::RollingAdler32(std::string_view window) noexcept
+    : m_windowSize { static_cast<uint32_t>(window.size() % MOD_ADLER) }
+{
+    const auto digest = adler32(window);
+    m_a = digest & 0xFFFF;
+    m_b = digest >> 16;
+}
+
+void filediff::RollingAdler32::Roll(unsigned char out, unsigned char in) noexcept
+{
+    // a' = a - out + in, b' = b - n * out + a' - 1 (all modulo MOD_ADLER, kept non-negative)
+    m_a = (m_a + MOD_ADLER - out + in) % MOD_ADLER;
+    const auto removed = (m_windowSize * out) % MOD_ADLER;
+    m_b = (m_b + MOD_ADLER - removed + m_a + MOD_ADLER - 1) % MOD_ADLER;
+}
+
+uint32_t filediff::RollingAdler32::Digest() const noexcept
+{
+    return (m_b << 16) | m_a;
 }
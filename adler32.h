@@ -1,3 +1,41 @@
+#ifndef ADLER32_H
+#define ADLER32_H
+
+#include <cstdint>
 #include <string_view>
 
+namespace filediff {
+
+enum class Adler32Kernel {
+    SCALAR,
+    SSE41,
+    AVX2
+};
+
+// uses the fastest kernel supported by the CPU, picked once at first call
 uint32_t adler32(std::string_view data);
+
+// forces given kernel, meant for tests and benchmarks; kernel must be supported by the CPU
+uint32_t adler32(std::string_view data, Adler32Kernel kernel);
+
+bool adler32KernelSupported(Adler32Kernel kernel) noexcept;
+
+// Adler-32 of a fixed size window which can be slid forward by one byte in O(1), as used by rsync
+class RollingAdler32
+{
+public:
+    explicit RollingAdler32(std::string_view window) noexcept;
+
+    // drops 'out' (first byte of the window) and appends 'in' right after the last one
+    void Roll(unsigned char out, unsigned char in) noexcept;
+
+    uint32_t Digest() const noexcept;
+
+private:
+    uint32_t m_a;
+    uint32_t m_b;
+    uint32_t m_windowSize; // already reduced modulo MOD_ADLER
+};
+
+} // filediff
+#endif // ADLER32_H
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+#include "alignment.h"
+
+namespace {
+
+// chunks repeating more often are not used as histogram anchors, like in git, such ranges are left unaligned
+constexpr uint32_t MAX_ANCHOR_OCCURRENCES { 64 };
+
+constexpr size_t NONE { std::numeric_limits<size_t>::max() };
+
+struct Range {
+    size_t oldBegin;
+    size_t oldEnd;
+    size_t newBegin;
+    size_t newEnd;
+};
+
+struct Occurrences {
+    uint32_t oldCount { 0 };
+    uint32_t newCount { 0 };
+    size_t oldPosition { 0 }; // first one in the range
+    size_t newPosition { 0 };
+};
+
+using Pairs = std::vector<std::pair<size_t, size_t>>;
+
+// longest subsequence of anchors (sorted by new position) ascending in old position, found by patience sorting
+Pairs LongestIncreasingRun(const Pairs& anchors)
+{
+    std::vector<size_t> tops; // tops[k] is the anchor ending the run of length k + 1 with the smallest old position
+    std::vector<size_t> previous(anchors.size(), NONE);
+    for (size_t i { 0 }; i < anchors.size(); ++i) {
+        const auto it { std::lower_bound(tops.begin(), tops.end(), anchors[i].first,
+            [&anchors](size_t top, size_t oldPosition) { return anchors[top].first < oldPosition; }) };
+        if (it != tops.begin()) {
+            previous[i] = *std::prev(it);
+        }
+        if (it == tops.end()) {
+            tops.push_back(i);
+        } else {
+            *it = i;
+        }
+    }
+
+    Pairs run;
+    for (auto i { tops.empty() ? NONE : tops.back() }; i != NONE; i = previous[i]) {
+        run.push_back(anchors[i]);
+    }
+    std::reverse(run.begin(), run.end());
+    return run;
+}
+
+} // namespace
+
+std::vector<std::pair<size_t, size_t>> filediff::PatienceAlign(std::span<const uint32_t> oldHashes, std::span<const uint32_t> newHashes,
+    const std::function<bool(size_t oldPosition, size_t newPosition)>& equal)
+{
+    auto same = [&](size_t oldPosition, size_t newPosition) {
+        return oldHashes[oldPosition] == newHashes[newPosition] && equal(oldPosition, newPosition);
+    };
+
+    // ranges are processed from a stack instead of recursing, aligned pairs are sorted once at the end
+    Pairs aligned;
+    std::vector<Range> pending { { 0, oldHashes.size(), 0, newHashes.size() } };
+    while (!pending.empty()) {
+        auto range { pending.back() };
+        pending.pop_back();
+
+        while (range.oldBegin < range.oldEnd && range.newBegin < range.newEnd && same(range.oldBegin, range.newBegin)) {
+            aligned.emplace_back(range.oldBegin++, range.newBegin++);
+        }
+        while (range.oldBegin < range.oldEnd && range.newBegin < range.newEnd && same(range.oldEnd - 1, range.newEnd - 1)) {
+            aligned.emplace_back(--range.oldEnd, --range.newEnd);
+        }
+        if (range.oldBegin == range.oldEnd || range.newBegin == range.newEnd) {
+            continue;
+        }
+
+        std::unordered_map<uint32_t, Occurrences> occurrences;
+        occurrences.reserve(range.oldEnd - range.oldBegin);
+        for (auto i { range.oldBegin }; i < range.oldEnd; ++i) {
+            auto& entry { occurrences[oldHashes[i]] };
+            if (entry.oldCount++ == 0) {
+                entry.oldPosition = i;
+            }
+        }
+        for (auto i { range.newBegin }; i < range.newEnd; ++i) {
+            const auto it { occurrences.find(newHashes[i]) };
+            if (it != occurrences.end() && it->second.newCount++ == 0) {
+                it->second.newPosition = i;
+            }
+        }
+
+        // anchors are collected in the order of new positions, which is what the longest run search expects
+        Pairs anchors;
+        const Occurrences* rarest { nullptr };
+        for (auto i { range.newBegin }; i < range.newEnd; ++i) {
+            const auto it { occurrences.find(newHashes[i]) };
+            if (it == occurrences.end() || it->second.newPosition != i) {
+                continue;
+            }
+            const auto& entry { it->second };
+            if (entry.oldCount == 1 && entry.newCount == 1) {
+                if (equal(entry.oldPosition, i)) {
+                    anchors.emplace_back(entry.oldPosition, i);
+                }
+            } else if (entry.oldCount <= MAX_ANCHOR_OCCURRENCES && (!rarest || entry.oldCount < rarest->oldCount)
+                && equal(entry.oldPosition, i)) {
+                rarest = &entry;
+            }
+        }
+        if (anchors.empty()) {
+            if (!rarest) {
+                continue;
+            }
+            anchors.emplace_back(rarest->oldPosition, rarest->newPosition);
+        } else {
+            anchors = LongestIncreasingRun(anchors);
+        }
+
+        auto oldBegin { range.oldBegin };
+        auto newBegin { range.newBegin };
+        for (const auto& [oldPosition, newPosition] : anchors) {
+            pending.push_back({ oldBegin, oldPosition, newBegin, newPosition });
+            aligned.emplace_back(oldPosition, newPosition);
+            oldBegin = oldPosition + 1;
+            newBegin = newPosition + 1;
+        }
+        pending.push_back({ oldBegin, range.oldEnd, newBegin, range.newEnd });
+    }
+
+    std::sort(aligned.begin(), aligned.end());
+    return aligned;
+}
@@ -0,0 +1,21 @@
+#ifndef ALIGNMENT_H
+#define ALIGNMENT_H
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace filediff {
+
+// Aligns old chunk sequence with the new one by patience diff: common prefix and suffix are matched first, then chunks
+// occurring exactly once on both sides anchor the longest run kept in order and gaps between anchors are aligned the
+// same way. Ranges without unique chunks are anchored on their least frequent common chunk (histogram diff).
+// Returns pairs (old position, new position) of aligned chunks, ascending in both positions. 'equal' is asked only
+// for chunks with the same weak hash and confirms they are really the same (e.g. by comparing strong hashes).
+std::vector<std::pair<size_t, size_t>> PatienceAlign(std::span<const uint32_t> oldHashes, std::span<const uint32_t> newHashes,
+    const std::function<bool(size_t oldPosition, size_t newPosition)>& equal);
+
+} // filediff
+#endif // ALIGNMENT_H
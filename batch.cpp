@@ -0,0 +1,136 @@
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#include "batch.h"
+#include "deltaformat.h"
+#include "threadpool.h"
+
+namespace {
+
+// sizes of files mapped by the job, missing file costs nothing (job fails right away)
+uint64_t JobCost(const filediff::Batch::Job& job)
+{
+    std::error_code error;
+    auto cost { std::filesystem::file_size(job.m_sigFileName, error) };
+    if (error) {
+        cost = 0;
+    }
+    const auto dataSize { std::filesystem::file_size(job.m_newDataFileName, error) };
+    return error ? cost : cost + dataSize;
+}
+
+void RunJob(const filediff::Batch::Job& job, const filediff::Batch::Options& options)
+{
+    // partially written delta never shows up under the output name
+    const auto tmpFileName { fmt::format("{}.tmp", job.m_outFileName) };
+    try {
+        {
+            std::ofstream out { tmpFileName, std::ios::binary };
+            if (!out) {
+                throw std::runtime_error(fmt::format("cannot create {}!", tmpFileName));
+            }
+            filediff::Delta delta { job.m_sigFileName, job.m_newDataFileName };
+            if (options.m_binaryFormat) {
+                // codec contexts are not shared between jobs running at once
+                const auto codec { filediff::MakeCodec(options.m_codec, options.m_codecLevel) };
+                filediff::BinaryDeltaWriter writer { out, delta.GetSignatureMetadata(), codec.get() };
+                delta.CalculateInstructions(std::ref(writer), options.m_engine);
+            } else {
+                delta.Calculate(filediff::Delta::StreamSink(out), options.m_engine);
+            }
+            out.flush();
+            if (!out) {
+                throw std::runtime_error(fmt::format("write to {} failed!", tmpFileName));
+            }
+        }
+        std::filesystem::rename(tmpFileName, job.m_outFileName);
+    } catch (...) {
+        std::remove(tmpFileName.c_str());
+        throw;
+    }
+}
+
+} // namespace
+
+filediff::Batch::Batch(std::string_view manifestFileName)
+{
+    std::ifstream manifest { std::string { manifestFileName } };
+    if (!manifest) {
+        throw std::runtime_error(fmt::format("Manifest {} cannot be opened!", manifestFileName));
+    }
+
+    std::string line;
+    for (size_t lineNumber { 1 }; std::getline(manifest, line); ++lineNumber) {
+        std::istringstream fields { line };
+        Job job;
+        if (!(fields >> job.m_sigFileName) || job.m_sigFileName.starts_with('#')) {
+            continue;
+        }
+        std::string extra;
+        if (!(fields >> job.m_newDataFileName >> job.m_outFileName) || fields >> extra) {
+            throw std::runtime_error(fmt::format("Manifest {} line {}: expected sigfile, newdata and outfile!", manifestFileName, lineNumber));
+        }
+        m_jobs.push_back(std::move(job));
+    }
+}
+
+const std::vector<filediff::Batch::Job>& filediff::Batch::GetJobs() const noexcept
+{
+    return m_jobs;
+}
+
+size_t filediff::Batch::Run(ThreadPool& pool, const Options& options, std::ostream& report) const
+{
+    std::mutex mutex; // guards everything below and the report stream
+    std::condition_variable released;
+    uint64_t inFlight { 0 };
+    size_t runningJobs { 0 };
+    size_t failedJobs { 0 };
+
+    std::vector<std::future<void>> results;
+    results.reserve(m_jobs.size());
+    for (const auto& job : m_jobs) {
+        const auto cost { JobCost(job) };
+        {
+            std::unique_lock lock { mutex };
+            released.wait(lock, [&] { return runningJobs == 0 || inFlight + cost <= options.m_memoryBudget; });
+            inFlight += cost;
+            runningJobs++;
+        }
+
+        results.push_back(pool.Submit([&, cost] {
+            std::string status { fmt::format("ok {}\n", job.m_outFileName) };
+            bool failed { false };
+            try {
+                RunJob(job, options);
+            } catch (const std::exception& e) {
+                status = fmt::format("error {}: {}\n", job.m_outFileName, e.what());
+                failed = true;
+            } catch (...) {
+                // budget has to be released whatever the job threw, the submitting loop may be waiting for it
+                status = fmt::format("error {}: unknown error\n", job.m_outFileName);
+                failed = true;
+            }
+            {
+                std::lock_guard lock { mutex };
+                report << status << std::flush;
+                failedJobs += failed;
+                inFlight -= cost;
+                runningJobs--;
+            }
+            released.notify_one();
+        }));
+    }
+    for (auto& result : results) {
+        result.get();
+    }
+    return failedJobs;
+}
@@ -0,0 +1,51 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "codec.h"
+#include "delta.h"
+
+namespace filediff {
+
+class ThreadPool;
+
+// Calculates many deltas in one process. Manifest lists one job per line: signature file, updated data file and output
+// file separated by whitespace; empty lines and lines starting with '#' are skipped.
+class Batch
+{
+public:
+    struct Job {
+        std::string m_sigFileName;
+        std::string m_newDataFileName;
+        std::string m_outFileName;
+    };
+
+    struct Options {
+        bool m_binaryFormat { false };
+        Delta::MatchingEngine m_engine { Delta::MatchingEngine::INDEXED };
+        uint64_t m_memoryBudget { 1ULL << 30 }; // in bytes, see Run()
+        CodecType m_codec { CodecType::NONE }; // binary format only
+        int m_codecLevel { 0 };
+    };
+
+    explicit Batch(std::string_view manifestFileName);
+
+    const std::vector<Job>& GetJobs() const noexcept;
+
+    // every job runs serially on one worker of the pool; a job is started only when sizes of its signature and data
+    // files together with the ones of jobs in flight fit into memory budget (a bigger job runs alone);
+    // output is written to a temporary file renamed when complete, then "ok <outfile>" or "error <outfile>: <reason>"
+    // is written to report as jobs complete; returns number of failed jobs
+    size_t Run(ThreadPool& pool, const Options& options, std::ostream& report) const;
+
+private:
+    std::vector<Job> m_jobs;
+};
+
+} // filediff
+#endif // BATCH_H
@@ -0,0 +1,593 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <numeric>
+#include <ostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <fmt/core.h>
+
+#include "../adler32.h"
+#include "../codec.h"
+#include "../delta.h"
+#include "../deltaformat.h"
+#include "../inputfile.h"
+#include "../readpipeline.h"
+#include "../signature.h"
+#include "../threadpool.h"
+
+namespace {
+
+// heap allocations made by the process while some benchmark counts them (see CountedAllocations), the others do not
+// pay for the atomic increment
+std::atomic<bool> countingAllocations { false };
+std::atomic<size_t> allocations { 0 };
+
+// all replaceable allocation functions are replaced together and take memory from malloc (aligned_alloc for over
+// aligned types), so whichever form of delete a compiler pairs with a new the memory goes back to free
+void* Allocate(size_t size, size_t alignment = 0) noexcept
+{
+    if (countingAllocations.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    size = std::max<size_t>(size, 1);
+    return alignment == 0 ? std::malloc(size) : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void* AllocateOrThrow(size_t size, size_t alignment = 0)
+{
+    if (auto* pointer { Allocate(size, alignment) }) {
+        return pointer;
+    }
+    throw std::bad_alloc {};
+}
+
+} // namespace
+
+void* operator new(size_t size)
+{
+    return AllocateOrThrow(size);
+}
+
+void* operator new[](size_t size)
+{
+    return AllocateOrThrow(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return AllocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return AllocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return Allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return Allocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return Allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
+namespace {
+
+constexpr auto EDITED_LINES { 1000U };
+
+// how updated file differs from the base one
+enum class Workload {
+    APPEND, // 1% of new lines appended at the end
+    RANDOM_EDITS, // EDITED_LINES lines replaced at random positions
+    SHUFFLED, // same lines in random order
+    REWRITE // every line replaced
+};
+
+std::string_view WorkloadName(Workload workload)
+{
+    switch (workload) {
+    case Workload::APPEND:
+        return "append";
+    case Workload::RANDOM_EDITS:
+        return "edits";
+    case Workload::SHUFFLED:
+        return "shuffled";
+    default:
+        return "rewrite";
+    }
+}
+
+std::string BaseLine(size_t i)
+{
+    return fmt::format("{:08} lorem ipsum dolor sit amet {}", i, i * 2654435761U);
+}
+
+// Writes synthetic base file of given number of lines together with its signature and then an updated version of
+// it according to the workload. Files are kept in temp directory and reused between runs, base file and signatures
+// are shared by all workloads of the same size; the one with strong hashes is the one binary delta can be made of.
+struct SyntheticFiles {
+    explicit SyntheticFiles(size_t numberOfLines, Workload workload = Workload::RANDOM_EDITS)
+        : m_base { (std::filesystem::temp_directory_path() / fmt::format("filediff_bench_{}.base", numberOfLines)).string() }
+        , m_signature { m_base + ".sig" }
+        , m_strongSignature { m_base + ".strong.sig" }
+        , m_updated { (std::filesystem::temp_directory_path() / fmt::format("filediff_bench_{}.{}.new", numberOfLines, WorkloadName(workload))).string() }
+    {
+        if (!std::filesystem::exists(m_signature) || !std::filesystem::exists(m_strongSignature)) {
+            std::ofstream base { m_base };
+            for (size_t i { 0 }; i < numberOfLines; ++i) {
+                base << BaseLine(i) << "\n";
+            }
+            base.close();
+
+            for (const auto strongHashes : { false, true }) {
+                filediff::Signature signature { m_base, filediff::Signature::InputFileType::BASIS, filediff::Signature::ChunkingMode::LINE, 1,
+                    nullptr, strongHashes };
+                std::ofstream sig { strongHashes ? m_strongSignature : m_signature, std::ios::binary };
+                signature.Serialize(sig);
+            }
+        }
+        if (!std::filesystem::exists(m_updated)) {
+            WriteUpdated(numberOfLines, workload);
+        }
+    }
+
+    void WriteUpdated(size_t numberOfLines, Workload workload) const
+    {
+        std::mt19937 generator { 42 };
+        std::vector<size_t> order(numberOfLines);
+        std::iota(std::begin(order), std::end(order), 0);
+        if (workload == Workload::SHUFFLED) {
+            std::shuffle(std::begin(order), std::end(order), generator);
+        }
+        std::vector<bool> edited(numberOfLines, workload == Workload::REWRITE);
+        if (workload == Workload::RANDOM_EDITS) {
+            std::uniform_int_distribution<size_t> lineDistribution { 0, numberOfLines - 1 };
+            for (auto i { 0U }; i < EDITED_LINES; ++i) {
+                edited[lineDistribution(generator)] = true;
+            }
+        }
+
+        std::ofstream updated { m_updated };
+        for (size_t i { 0 }; i < numberOfLines; ++i) {
+            updated << (edited[i] ? fmt::format("edited {}", i) : BaseLine(order[i])) << "\n";
+        }
+        if (workload == Workload::APPEND) {
+            for (size_t i { 0 }; i < std::max<size_t>(numberOfLines / 100, 1); ++i) {
+                updated << fmt::format("appended {}", i) << "\n";
+            }
+        }
+    }
+
+    std::string m_base;
+    std::string m_signature;
+    std::string m_strongSignature;
+    std::string m_updated;
+};
+
+// counts heap allocations made while it lives
+class CountedAllocations {
+public:
+    CountedAllocations() noexcept
+    {
+        allocations.store(0, std::memory_order_relaxed);
+        countingAllocations.store(true, std::memory_order_relaxed);
+    }
+
+    ~CountedAllocations()
+    {
+        countingAllocations.store(false, std::memory_order_relaxed);
+    }
+
+    CountedAllocations(const CountedAllocations&) = delete;
+    CountedAllocations& operator=(const CountedAllocations&) = delete;
+
+    size_t Get() const noexcept
+    {
+        return allocations.load(std::memory_order_relaxed);
+    }
+};
+
+// allocs counter is the number of heap allocations per run, with per run storage in the arena or straight on the heap
+void BM_DeltaCalculate(benchmark::State& state, filediff::Delta::MatchingEngine engine, bool useArena = true)
+{
+    const SyntheticFiles files { static_cast<size_t>(state.range(0)) };
+    const CountedAllocations counted;
+    for (auto _ : state) {
+        filediff::Delta delta { files.m_signature, files.m_updated };
+        delta.UseArena(useArena);
+        delta.Calculate(engine);
+        benchmark::DoNotOptimize(delta.IsChanged());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["allocs"] = benchmark::Counter(static_cast<double>(counted.Get()), benchmark::Counter::kAvgIterations);
+}
+
+// stream buffer which discards everything written, counting only the number of bytes
+class CountingBuffer : public std::streambuf {
+public:
+    size_t m_size { 0 };
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        m_size++;
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize count) override
+    {
+        m_size += static_cast<size_t>(count);
+        return count;
+    }
+};
+
+// streams binary delta to a null sink, the way --delta --format binary runs minus the output
+void BM_DeltaWorkload(benchmark::State& state, Workload workload, filediff::Delta::MatchingEngine engine,
+    filediff::CodecType codecType = filediff::CodecType::NONE)
+{
+    if (!filediff::IsCodecAvailable(codecType)) {
+        state.SkipWithError("codec is not built in");
+        return;
+    }
+    const SyntheticFiles files { static_cast<size_t>(state.range(0)), workload };
+    const auto codec { filediff::MakeCodec(codecType) };
+    CountingBuffer buffer;
+    std::ostream counting { &buffer };
+    for (auto _ : state) {
+        buffer.m_size = 0;
+        filediff::Delta delta { files.m_strongSignature, files.m_updated };
+        filediff::BinaryDeltaWriter writer { counting, delta.GetSignatureMetadata(), codec.get() };
+        delta.CalculateInstructions(std::ref(writer), engine);
+    }
+    state.counters["delta_bytes"] = static_cast<double>(buffer.m_size);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(std::filesystem::file_size(files.m_updated)));
+}
+
+// literals of rewritten file cut into blocks the way binary delta writer does, bytes per second are the ones of
+// uncompressed literals in both directions
+void BM_LiteralCodec(benchmark::State& state, filediff::CodecType codecType, bool decompress)
+{
+    if (!filediff::IsCodecAvailable(codecType)) {
+        state.SkipWithError("codec is not built in");
+        return;
+    }
+    const SyntheticFiles files { static_cast<size_t>(state.range(0)), Workload::REWRITE };
+    std::string literals;
+    {
+        std::ifstream updated { files.m_updated, std::ios::binary };
+        literals.assign(std::istreambuf_iterator<char> { updated }, std::istreambuf_iterator<char> {});
+    }
+    const auto codec { filediff::MakeCodec(codecType, static_cast<int>(state.range(1))) };
+    std::vector<std::pair<size_t, std::string>> blocks;
+    for (size_t offset { 0 }; offset < literals.size(); offset += filediff::LITERAL_BLOCK_SIZE) {
+        const auto block { std::string_view { literals }.substr(offset, filediff::LITERAL_BLOCK_SIZE) };
+        blocks.emplace_back(block.size(), std::string {});
+        codec->Compress(block, blocks.back().second);
+    }
+
+    std::string out;
+    for (auto _ : state) {
+        for (size_t i { 0 }; i < blocks.size(); ++i) {
+            out.clear();
+            if (decompress) {
+                codec->Decompress(blocks[i].second, blocks[i].first, out);
+            } else {
+                codec->Compress(std::string_view { literals }.substr(i * filediff::LITERAL_BLOCK_SIZE, filediff::LITERAL_BLOCK_SIZE), out);
+            }
+            benchmark::DoNotOptimize(out.data());
+        }
+    }
+    size_t compressedSize { 0 };
+    for (const auto& [size, block] : blocks) {
+        compressedSize += block.size();
+    }
+    state.counters["ratio"] = static_cast<double>(literals.size()) / static_cast<double>(std::max<size_t>(compressedSize, 1));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(literals.size()));
+}
+
+void BM_SignatureBasis(benchmark::State& state)
+{
+    const SyntheticFiles files { static_cast<size_t>(state.range(0)) };
+    for (auto _ : state) {
+        filediff::Signature signature { files.m_base, filediff::Signature::InputFileType::BASIS };
+        benchmark::DoNotOptimize(signature.GetHashes().size());
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(std::filesystem::file_size(files.m_base)));
+}
+
+// drops clean pages of the file from page cache, so the next read goes to the device as if the file was cold
+void EvictFromPageCache(const std::string& path)
+{
+    const auto fd { ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (fd >= 0) {
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+}
+
+enum class ReadMethod {
+    MAPPED, // whole file mapped and hashed after page faults, the way signature was calculated before
+    THREAD, // read pipeline with reader thread
+    IO_URING // read pipeline with io_uring (reader thread if kernel does not allow it)
+};
+
+// line signature of base file, the second argument says whether the file is evicted from page cache before every
+// iteration; the mapped variant hashes lines the same way Signature does
+void BM_SignatureRead(benchmark::State& state, ReadMethod method)
+{
+    const SyntheticFiles files { static_cast<size_t>(state.range(0)) };
+    const auto cold { state.range(1) != 0 };
+    for (auto _ : state) {
+        if (cold) {
+            state.PauseTiming();
+            EvictFromPageCache(files.m_base);
+            state.ResumeTiming();
+        }
+        std::vector<uint32_t> hashes;
+        if (method == ReadMethod::MAPPED) {
+            const filediff::InputFile input { files.m_base };
+            filediff::ChunkReader reader { input.Data() };
+            while (const auto line { reader.NextLine() }) {
+                hashes.push_back(filediff::adler32(*line));
+            }
+        } else {
+            // generated lines are short, every piece has a line end; the line cut by the end of piece is carried over
+            filediff::ReadPipeline input { files.m_base,
+                method == ReadMethod::THREAD ? filediff::ReadPipeline::Backend::THREAD : filediff::ReadPipeline::Backend::AUTO };
+            std::string carry;
+            for (auto piece { input.Next() }; !piece.empty(); piece = input.Next()) {
+                const auto newline { piece.find('\n') };
+                carry.append(piece.substr(0, newline + 1));
+                hashes.push_back(filediff::adler32(std::string_view { carry }.substr(0, carry.size() - 1)));
+                piece.remove_prefix(newline + 1);
+                const auto end { piece.rfind('\n') + 1 };
+                filediff::ChunkReader reader { piece.substr(0, end) };
+                while (const auto line { reader.NextLine() }) {
+                    hashes.push_back(filediff::adler32(*line));
+                }
+                carry.assign(piece.substr(end));
+            }
+        }
+        benchmark::DoNotOptimize(hashes.data());
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(std::filesystem::file_size(files.m_base)));
+}
+
+void BM_SignatureLoad(benchmark::State& state)
+{
+    const SyntheticFiles files { static_cast<size_t>(state.range(0)) };
+    for (auto _ : state) {
+        filediff::Signature signature { files.m_signature, filediff::Signature::InputFileType::SIGNATURE };
+        benchmark::DoNotOptimize(signature.GetHashes().size());
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(std::filesystem::file_size(files.m_signature)));
+}
+
+// signature of the appended file from the base one against BM_SignatureBasis of whole file, the appended 1% of lines
+// is hashed and the rest only copied
+void BM_SignatureUpdate(benchmark::State& state)
+{
+    const SyntheticFiles files { static_cast<size_t>(state.range(0)), Workload::APPEND };
+    const filediff::Signature previous { files.m_signature, filediff::Signature::InputFileType::SIGNATURE };
+    for (auto _ : state) {
+        filediff::Signature signature { files.m_updated, previous, previous.GetMetadata().m_fileSize };
+        benchmark::DoNotOptimize(signature.GetHashes().size());
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(std::filesystem::file_size(files.m_updated)));
+}
+
+// Hash lookups over per-line metadata as the matcher does them: interleaved records in a deque (layout used before)
+// against hashes in their own contiguous array. Cache misses can be added to the report with
+// --benchmark_perf_counters=CACHE-MISSES when Google Benchmark is built with libpfm.
+struct LineRecord {
+    uint32_t hash;
+    size_t offset;
+    uint32_t length;
+};
+
+template <typename Container>
+void BM_LineHashScan(benchmark::State& state)
+{
+    const auto numberOfLines { static_cast<size_t>(state.range(0)) };
+    Container lines;
+    std::mt19937 generator { 42 };
+    for (size_t i { 0 }; i < numberOfLines; ++i) {
+        if constexpr (std::is_same_v<Container, std::vector<uint32_t>>) {
+            lines.push_back(generator());
+        } else {
+            lines.push_back(LineRecord { static_cast<uint32_t>(generator()), i * 40, 39 });
+        }
+    }
+
+    auto hashAt = [&lines](size_t i) {
+        if constexpr (std::is_same_v<Container, std::vector<uint32_t>>) {
+            return lines[i];
+        } else {
+            return lines[i].hash;
+        }
+    };
+    const auto missing { hashAt(numberOfLines - 1) + 1 };
+    for (auto _ : state) {
+        size_t found { numberOfLines };
+        for (size_t i { 0 }; i < numberOfLines; ++i) {
+            if (hashAt(i) == missing) {
+                found = i;
+                break;
+            }
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_Adler32(benchmark::State& state, filediff::Adler32Kernel kernel)
+{
+    if (!filediff::adler32KernelSupported(kernel)) {
+        state.SkipWithError("kernel not supported by this CPU");
+        return;
+    }
+
+    std::string data(static_cast<size_t>(state.range(0)), '\0');
+    std::mt19937 generator { 42 };
+    std::generate(std::begin(data), std::end(data), [&generator] { return static_cast<char>(generator()); });
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(filediff::adler32(data, kernel));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void BM_SignatureThreads(benchmark::State& state)
+{
+    const SyntheticFiles files { 1'000'000 };
+    filediff::ThreadPool pool { static_cast<unsigned>(state.range(0)) };
+    for (auto _ : state) {
+        filediff::Signature signature { files.m_base, filediff::Signature::InputFileType::BASIS,
+            filediff::Signature::ChunkingMode::LINE, 1, &pool };
+        benchmark::DoNotOptimize(signature.GetHashes().size());
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(std::filesystem::file_size(files.m_base)));
+}
+
+} // namespace
+
+BENCHMARK(BM_SignatureThreads)
+    ->RangeMultiplier(2)
+    ->Range(1, static_cast<int64_t>(std::max(std::thread::hardware_concurrency(), 1U)))
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Adler32, Scalar, filediff::Adler32Kernel::SCALAR)->RangeMultiplier(16)->Range(16, 16 << 20);
+BENCHMARK_CAPTURE(BM_Adler32, SSE41, filediff::Adler32Kernel::SSE41)->RangeMultiplier(16)->Range(16, 16 << 20);
+BENCHMARK_CAPTURE(BM_Adler32, AVX2, filediff::Adler32Kernel::AVX2)->RangeMultiplier(16)->Range(16, 16 << 20);
+
+BENCHMARK_TEMPLATE(BM_LineHashScan, std::deque<LineRecord>)->Arg(1'000'000)->Arg(10'000'000);
+BENCHMARK_TEMPLATE(BM_LineHashScan, std::vector<uint32_t>)->Arg(1'000'000)->Arg(10'000'000);
+
+BENCHMARK(BM_SignatureBasis)->Arg(10'000)->Arg(1'000'000)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_SignatureRead, Mapped, ReadMethod::MAPPED)->Args({ 10'000'000, 0 })->Args({ 10'000'000, 1 })->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_SignatureRead, Thread, ReadMethod::THREAD)->Args({ 10'000'000, 0 })->Args({ 10'000'000, 1 })->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_SignatureRead, IoUring, ReadMethod::IO_URING)->Args({ 10'000'000, 0 })->Args({ 10'000'000, 1 })->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SignatureLoad)->Arg(10'000)->Arg(1'000'000)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SignatureUpdate)->Arg(10'000)->Arg(1'000'000)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(BM_DeltaWorkload, Append, Workload::APPEND, filediff::Delta::MatchingEngine::INDEXED)->Arg(10'000)->Arg(1'000'000)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeltaWorkload, RandomEdits, Workload::RANDOM_EDITS, filediff::Delta::MatchingEngine::INDEXED)->Arg(10'000)->Arg(1'000'000)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeltaWorkload, Shuffled, Workload::SHUFFLED, filediff::Delta::MatchingEngine::INDEXED)->Arg(10'000)->Arg(1'000'000)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeltaWorkload, Rewrite, Workload::REWRITE, filediff::Delta::MatchingEngine::INDEXED)->Arg(10'000)->Arg(1'000'000)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeltaWorkload, RandomEditsPatience, Workload::RANDOM_EDITS, filediff::Delta::MatchingEngine::PATIENCE)->Arg(10'000)->Arg(1'000'000)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeltaWorkload, ShuffledPatience, Workload::SHUFFLED, filediff::Delta::MatchingEngine::PATIENCE)->Arg(10'000)->Arg(1'000'000)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(BM_DeltaWorkload, RewriteZlib, Workload::REWRITE, filediff::Delta::MatchingEngine::INDEXED, filediff::CodecType::ZLIB)->Arg(1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeltaWorkload, RewriteZstd, Workload::REWRITE, filediff::Delta::MatchingEngine::INDEXED, filediff::CodecType::ZSTD)->Arg(1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeltaWorkload, RewriteLz4, Workload::REWRITE, filediff::Delta::MatchingEngine::INDEXED, filediff::CodecType::LZ4)->Arg(1'000'000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(BM_LiteralCodec, ZlibCompress, filediff::CodecType::ZLIB, false)->Args({ 1'000'000, 1 })->Args({ 1'000'000, 6 })->Args({ 1'000'000, 9 })->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_LiteralCodec, ZlibDecompress, filediff::CodecType::ZLIB, true)->Args({ 1'000'000, 6 })->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_LiteralCodec, ZstdCompress, filediff::CodecType::ZSTD, false)->Args({ 1'000'000, 1 })->Args({ 1'000'000, 3 })->Args({ 1'000'000, 19 })->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_LiteralCodec, ZstdDecompress, filediff::CodecType::ZSTD, true)->Args({ 1'000'000, 3 })->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_LiteralCodec, Lz4Compress, filediff::CodecType::LZ4, false)->Args({ 1'000'000, 1 })->Args({ 1'000'000, 9 })->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_LiteralCodec, Lz4Decompress, filediff::CodecType::LZ4, true)->Args({ 1'000'000, 1 })->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(BM_DeltaCalculate, Indexed, filediff::Delta::MatchingEngine::INDEXED)
+    ->Arg(1'000'000)
+    ->Arg(10'000'000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeltaCalculate, IndexedHeap, filediff::Delta::MatchingEngine::INDEXED, false)
+    ->Arg(1'000'000)
+    ->Arg(10'000'000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeltaCalculate, Linear, filediff::Delta::MatchingEngine::LINEAR)
+    ->Arg(1'000'000)
+    ->Arg(10'000'000)
+    ->Unit(benchmark::kMillisecond)
+    ->Iterations(1);
+
+BENCHMARK_MAIN();
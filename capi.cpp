@@ -0,0 +1,284 @@
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+
+#include <fmt/core.h>
+
+#include "capi.h"
+#include "codec.h"
+#include "delta.h"
+#include "deltaformat.h"
+#include "signature.h"
+#include "threadpool.h"
+
+struct filediff_signature {
+    filediff::Signature m_signature;
+};
+
+namespace {
+
+thread_local std::string lastError;
+
+// thrown when a callback asks to stop, unwinds the calculation up to the interface
+struct Aborted {
+};
+
+// stream buffer handing its content to the write callback in large pieces
+class CallbackBuffer : public std::streambuf
+{
+public:
+    CallbackBuffer(filediff_write_fn write, void* context)
+        : m_write { write }
+        , m_context { context }
+    {
+        setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+    }
+
+protected:
+    int_type overflow(int_type character) override
+    {
+        Flush();
+        if (!traits_type::eq_int_type(character, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(character);
+            pbump(1);
+        }
+        return traits_type::not_eof(character);
+    }
+
+    int sync() override
+    {
+        Flush();
+        return 0;
+    }
+
+private:
+    void Flush()
+    {
+        const auto size { static_cast<size_t>(pptr() - pbase()) };
+        setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+        if (size != 0 && m_write(m_context, m_buffer.data(), size) != 0) {
+            throw Aborted {};
+        }
+    }
+
+    filediff_write_fn m_write;
+    void* m_context;
+    std::array<char, 64 << 10> m_buffer;
+};
+
+// runs call translating exceptions to status and last error
+template<typename Call>
+filediff_status Guarded(Call&& call) noexcept
+{
+    try {
+        call();
+        lastError.clear();
+        return FILEDIFF_OK;
+    } catch (const Aborted&) {
+        lastError = "Aborted by callback!";
+        return FILEDIFF_ABORTED;
+    } catch (const std::bad_alloc&) {
+        lastError = "Out of memory!";
+        return FILEDIFF_OUT_OF_MEMORY;
+    } catch (const std::invalid_argument& e) {
+        lastError = e.what();
+        return FILEDIFF_INVALID_ARGUMENT;
+    } catch (const std::exception& e) {
+        lastError = e.what();
+        return FILEDIFF_ERROR;
+    } catch (...) {
+        lastError = "Unknown error!";
+        return FILEDIFF_ERROR;
+    }
+}
+
+void RequireArgument(bool condition, const char* name)
+{
+    if (!condition) {
+        throw std::invalid_argument(fmt::format("{} must not be NULL!", name));
+    }
+}
+
+std::span<const std::byte> Bytes(const void* data, size_t size)
+{
+    RequireArgument(data != nullptr || size == 0, "data");
+    return { static_cast<const std::byte*>(data), size };
+}
+
+// pool kept by the caller, none for a single thread
+filediff::ThreadPool* StartPool(std::optional<filediff::ThreadPool>& pool, uint32_t threads)
+{
+    if (threads > 1) {
+        pool.emplace(threads);
+    }
+    return pool ? &*pool : nullptr;
+}
+
+// signature of data given either in memory or as path, according to options
+template<typename Input>
+filediff::Signature CalculateSignature(const Input& input, const filediff_signature_options* options)
+{
+    const filediff_signature_options defaults {};
+    const auto& parameters { options ? *options : defaults };
+    std::optional<filediff::ThreadPool> pool;
+    const auto poolPointer { StartPool(pool, parameters.threads) };
+    switch (parameters.chunking) {
+    case FILEDIFF_CHUNKING_LINE:
+    case FILEDIFF_CHUNKING_BLOCK:
+        return filediff::Signature { input, filediff::Signature::InputFileType::BASIS,
+            static_cast<filediff::Signature::ChunkingMode>(parameters.chunking), parameters.chunk_length, poolPointer, parameters.strong_hashes != 0 };
+    case FILEDIFF_CHUNKING_CDC: {
+        const auto cdc { filediff::DefaultCdcParameters(parameters.chunk_length) };
+        return filediff::Signature { input,
+            filediff::CdcParameters { parameters.min_chunk_length ? parameters.min_chunk_length : cdc.m_minLength, cdc.m_averageLength,
+                parameters.max_chunk_length ? parameters.max_chunk_length : cdc.m_maxLength },
+            poolPointer };
+    }
+    default:
+        throw std::invalid_argument(fmt::format("Unknown chunking mode {}!", parameters.chunking));
+    }
+}
+
+filediff::Delta::MatchingEngine Engine(uint32_t engine)
+{
+    if (engine > FILEDIFF_ENGINE_PATIENCE) {
+        throw std::invalid_argument(fmt::format("Unknown matching engine {}!", engine));
+    }
+    return static_cast<filediff::Delta::MatchingEngine>(engine);
+}
+
+} // namespace
+
+uint32_t filediff_abi_version(void)
+{
+    return FILEDIFF_ABI_VERSION;
+}
+
+const char* filediff_last_error(void)
+{
+    return lastError.c_str();
+}
+
+filediff_status filediff_signature_calculate(const void* data, size_t size, const filediff_signature_options* options,
+    filediff_signature** signature)
+{
+    return Guarded([&] {
+        RequireArgument(signature != nullptr, "signature");
+        *signature = new filediff_signature { CalculateSignature(Bytes(data, size), options) };
+    });
+}
+
+filediff_status filediff_signature_calculate_file(const char* path, const filediff_signature_options* options, filediff_signature** signature)
+{
+    return Guarded([&] {
+        RequireArgument(path != nullptr, "path");
+        RequireArgument(signature != nullptr, "signature");
+        *signature = new filediff_signature { CalculateSignature(std::string_view { path }, options) };
+    });
+}
+
+filediff_status filediff_signature_load(const void* data, size_t size, filediff_signature** signature)
+{
+    return Guarded([&] {
+        RequireArgument(signature != nullptr, "signature");
+        *signature = new filediff_signature { filediff::Signature { Bytes(data, size), filediff::Signature::InputFileType::SIGNATURE } };
+    });
+}
+
+filediff_status filediff_signature_load_file(const char* path, filediff_signature** signature)
+{
+    return Guarded([&] {
+        RequireArgument(path != nullptr, "path");
+        RequireArgument(signature != nullptr, "signature");
+        *signature = new filediff_signature { filediff::Signature { path, filediff::Signature::InputFileType::SIGNATURE } };
+    });
+}
+
+filediff_status filediff_signature_add_tree(filediff_signature* signature, uint32_t fanout)
+{
+    return Guarded([&] {
+        RequireArgument(signature != nullptr, "signature");
+        signature->m_signature.AddTree(fanout);
+    });
+}
+
+filediff_status filediff_signature_serialize(const filediff_signature* signature, filediff_write_fn write, void* context)
+{
+    return Guarded([&] {
+        RequireArgument(signature != nullptr, "signature");
+        RequireArgument(write != nullptr, "write");
+        CallbackBuffer buffer { write, context };
+        std::ostream out { &buffer };
+        out.exceptions(std::ios::badbit);
+        signature->m_signature.Serialize(out);
+        out.flush();
+    });
+}
+
+void filediff_signature_free(filediff_signature* signature)
+{
+    delete signature;
+}
+
+filediff_status filediff_delta(const filediff_signature* signature, const void* data, size_t size, const filediff_delta_options* options,
+    filediff_write_fn write, void* context)
+{
+    return Guarded([&] {
+        RequireArgument(signature != nullptr, "signature");
+        RequireArgument(write != nullptr, "write");
+        const filediff_delta_options defaults {};
+        const auto& parameters { options ? *options : defaults };
+        if (parameters.format > FILEDIFF_FORMAT_BINARY || parameters.codec > FILEDIFF_CODEC_LZ4
+            || (parameters.codec != FILEDIFF_CODEC_NONE && parameters.format != FILEDIFF_FORMAT_BINARY)) {
+            throw std::invalid_argument("Codec shall be one of filediff_codec and used with binary format!");
+        }
+        const auto engine { Engine(parameters.engine) };
+        std::optional<filediff::ThreadPool> pool;
+        const auto poolPointer { StartPool(pool, parameters.threads) };
+
+        CallbackBuffer buffer { write, context };
+        std::ostream out { &buffer };
+        // the streambuf may throw Aborted, it is rethrown instead of only setting badbit
+        out.exceptions(std::ios::badbit);
+        filediff::Delta delta { signature->m_signature, Bytes(data, size) };
+        if (parameters.format == FILEDIFF_FORMAT_BINARY) {
+            const auto codec { filediff::MakeCodec(static_cast<filediff::CodecType>(parameters.codec), parameters.codec_level) };
+            filediff::BinaryDeltaWriter writer { out, delta.GetSignatureMetadata(), codec.get() };
+            delta.CalculateInstructions(std::ref(writer), engine, poolPointer);
+        } else {
+            delta.Calculate(filediff::Delta::StreamSink(out), engine, poolPointer);
+        }
+        out.flush();
+    });
+}
+
+filediff_status filediff_delta_instructions(const filediff_signature* signature, const void* data, size_t size,
+    const filediff_delta_options* options, filediff_instruction_fn sink, void* context)
+{
+    return Guarded([&] {
+        RequireArgument(signature != nullptr, "signature");
+        RequireArgument(sink != nullptr, "sink");
+        const filediff_delta_options defaults {};
+        const auto& parameters { options ? *options : defaults };
+        const auto engine { Engine(parameters.engine) };
+        std::optional<filediff::ThreadPool> pool;
+        const auto poolPointer { StartPool(pool, parameters.threads) };
+
+        filediff::Delta delta { signature->m_signature, Bytes(data, size) };
+        delta.CalculateInstructions([sink, context](const filediff::Delta::Instruction& instruction) {
+            const filediff_instruction converted { static_cast<uint32_t>(instruction.m_type), instruction.m_hash, instruction.m_baseChunk,
+                instruction.m_data.data(), instruction.m_data.size() };
+            if (sink(context, &converted) != 0) {
+                throw Aborted {};
+            }
+        },
+            engine, poolPointer);
+    });
+}
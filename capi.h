@@ -0,0 +1,126 @@
+#ifndef CAPI_H
+#define CAPI_H
+
+// Stable C interface of libfilediff for callers which cannot use the C++ classes (other languages, other compilers
+// or standard libraries). Objects are opaque, every call reports failure by its status and the reason is kept in
+// filediff_last_error() of the calling thread; no exception crosses this interface. Options structures have fixed
+// width fields only, zero initialized ones (or NULL) stand for the defaults. Existing declarations do not change
+// within one FILEDIFF_ABI_VERSION, new ones may be added.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FILEDIFF_ABI_VERSION 1
+
+typedef enum filediff_status {
+    FILEDIFF_OK = 0,
+    FILEDIFF_INVALID_ARGUMENT = 1, // bad option or parameter value
+    FILEDIFF_ERROR = 2, // file cannot be read, signature is corrupted and the like
+    FILEDIFF_OUT_OF_MEMORY = 3,
+    FILEDIFF_ABORTED = 4 // callback returned nonzero
+} filediff_status;
+
+typedef enum filediff_chunking {
+    FILEDIFF_CHUNKING_LINE = 0,
+    FILEDIFF_CHUNKING_BLOCK = 1,
+    FILEDIFF_CHUNKING_CDC = 2
+} filediff_chunking;
+
+typedef enum filediff_engine {
+    FILEDIFF_ENGINE_INDEXED = 0,
+    FILEDIFF_ENGINE_LINEAR = 1,
+    FILEDIFF_ENGINE_PATIENCE = 2
+} filediff_engine;
+
+typedef enum filediff_format {
+    FILEDIFF_FORMAT_TEXT = 0,
+    FILEDIFF_FORMAT_BINARY = 1
+} filediff_format;
+
+typedef enum filediff_codec {
+    FILEDIFF_CODEC_NONE = 0,
+    FILEDIFF_CODEC_ZLIB = 1,
+    FILEDIFF_CODEC_ZSTD = 2,
+    FILEDIFF_CODEC_LZ4 = 3
+} filediff_codec;
+
+typedef enum filediff_instruction_type {
+    FILEDIFF_INSTRUCTION_COPY = 0,
+    FILEDIFF_INSTRUCTION_LITERAL = 1,
+    FILEDIFF_INSTRUCTION_REMOVED = 2,
+    FILEDIFF_INSTRUCTION_END = 3
+} filediff_instruction_type;
+
+typedef struct filediff_signature_options {
+    uint32_t chunking; // filediff_chunking
+    uint32_t chunk_length; // block size in BLOCK mode, average chunk length in CDC mode
+    uint32_t min_chunk_length; // CDC mode only, 0 for average / 4 (at least 64)
+    uint32_t max_chunk_length; // CDC mode only, 0 for average * 8
+    uint32_t strong_hashes; // nonzero stores XXH64 of every line in LINE mode too
+    uint32_t threads; // hashing threads, 0 or 1 hashes on the calling thread
+} filediff_signature_options;
+
+typedef struct filediff_delta_options {
+    uint32_t engine; // filediff_engine
+    uint32_t format; // filediff_format, used by filediff_delta() only
+    uint32_t codec; // filediff_codec compressing binary delta literals
+    int32_t codec_level; // 0 for the default level of the codec
+    uint32_t threads; // 0 or 1 calculates delta on the calling thread
+} filediff_delta_options;
+
+// see Delta::Instruction, data stays valid until the delta call returns
+typedef struct filediff_instruction {
+    uint32_t type; // filediff_instruction_type
+    uint32_t hash;
+    uint64_t base_chunk;
+    const char* data;
+    size_t size;
+} filediff_instruction;
+
+// output callbacks, nonzero return stops the call with FILEDIFF_ABORTED
+typedef int (*filediff_write_fn)(void* context, const void* data, size_t size);
+typedef int (*filediff_instruction_fn)(void* context, const filediff_instruction* instruction);
+
+typedef struct filediff_signature filediff_signature;
+
+// FILEDIFF_ABI_VERSION the library was built with, callers compare it with the one of the header they use
+uint32_t filediff_abi_version(void);
+
+// reason of the last failed call on the calling thread, empty string if there was none
+const char* filediff_last_error(void);
+
+// signature of base data held by the caller (data is not referred to once the call returns) or of base file
+filediff_status filediff_signature_calculate(const void* data, size_t size, const filediff_signature_options* options,
+    filediff_signature** signature);
+filediff_status filediff_signature_calculate_file(const char* path, const filediff_signature_options* options,
+    filediff_signature** signature);
+
+// signature serialized by filediff_signature_serialize() (or signature file), from memory or from file
+filediff_status filediff_signature_load(const void* data, size_t size, filediff_signature** signature);
+filediff_status filediff_signature_load_file(const char* path, filediff_signature** signature);
+
+// adds hash tree over runs of fanout blocks to BLOCK mode signature, see Signature::AddTree()
+filediff_status filediff_signature_add_tree(filediff_signature* signature, uint32_t fanout);
+
+filediff_status filediff_signature_serialize(const filediff_signature* signature, filediff_write_fn write, void* context);
+
+void filediff_signature_free(filediff_signature* signature);
+
+// delta of updated data against signature written in text or binary format, output is passed to write in pieces as
+// it is produced
+filediff_status filediff_delta(const filediff_signature* signature, const void* data, size_t size, const filediff_delta_options* options,
+    filediff_write_fn write, void* context);
+
+// delta as a stream of instructions (format and codec options are not used)
+filediff_status filediff_delta_instructions(const filediff_signature* signature, const void* data, size_t size,
+    const filediff_delta_options* options, filediff_instruction_fn sink, void* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAPI_H
@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+
+#include "cdc.h"
+
+namespace {
+
+constexpr uint32_t MIN_CHUNK_LENGTH { 64 };
+
+// fixed pseudo random table (splitmix64), part of the signature format since it decides where chunks end
+constexpr std::array<uint64_t, 256> GEAR { [] {
+    std::array<uint64_t, 256> table {};
+    uint64_t state { 0x9E3779B97F4A7C15ULL };
+    for (auto& value : table) {
+        state += 0x9E3779B97F4A7C15ULL;
+        auto z { state };
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        value = z ^ (z >> 31);
+    }
+    return table;
+}() };
+
+// top bits of gear hash depend on the most bytes, masks select them
+constexpr uint64_t TopBitsMask(unsigned bits) noexcept
+{
+    return bits == 0 ? 0 : ~0ULL << (64 - std::min(bits, 63U));
+}
+
+} // namespace
+
+filediff::CdcParameters filediff::DefaultCdcParameters(uint32_t averageLength) noexcept
+{
+    return { std::max<uint32_t>(averageLength / 4, MIN_CHUNK_LENGTH), averageLength, averageLength * 8 };
+}
+
+void filediff::ValidateCdcParameters(const CdcParameters& parameters)
+{
+    if (parameters.m_minLength < MIN_CHUNK_LENGTH || parameters.m_minLength > parameters.m_averageLength
+        || parameters.m_averageLength > parameters.m_maxLength) {
+        throw std::invalid_argument("Chunk lengths must satisfy 64 <= min <= average <= max!");
+    }
+}
+
+size_t filediff::CdcChunkLength(std::string_view data, const CdcParameters& parameters) noexcept
+{
+    if (data.size() <= parameters.m_minLength) {
+        return data.size();
+    }
+
+    // normalized chunking: one more bit before the average length and one less after it keeps lengths close to it
+    const auto bits { static_cast<unsigned>(std::bit_width(parameters.m_averageLength) - 1) };
+    const auto strictMask { TopBitsMask(bits + 1) };
+    const auto looseMask { TopBitsMask(bits - 1) };
+    const auto end { std::min<size_t>(data.size(), parameters.m_maxLength) };
+    const auto normal { std::min<size_t>(end, parameters.m_averageLength) };
+
+    uint64_t hash { 0 };
+    size_t i { parameters.m_minLength };
+    for (; i < normal; ++i) {
+        hash = (hash << 1) + GEAR[static_cast<unsigned char>(data[i])];
+        if ((hash & strictMask) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < end; ++i) {
+        hash = (hash << 1) + GEAR[static_cast<unsigned char>(data[i])];
+        if ((hash & looseMask) == 0) {
+            return i + 1;
+        }
+    }
+    return end;
+}
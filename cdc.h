@@ -0,0 +1,27 @@
+#ifndef CDC_H
+#define CDC_H
+
+#include <cstdint>
+#include <string_view>
+
+namespace filediff {
+
+// Content-defined chunking parameters (FastCDC): chunk ends where the gear hash of preceding bytes hits a mask, so
+// boundaries move together with the content and an insertion changes only the chunks around it
+struct CdcParameters {
+    uint32_t m_minLength; // no boundary is looked for before that many bytes
+    uint32_t m_averageLength; // expected chunk length, stricter mask is used before it and looser one after
+    uint32_t m_maxLength; // chunk is cut here if no boundary was found
+};
+
+// limits used when only the average length is given: average / 4 (at least 64) and average * 8
+CdcParameters DefaultCdcParameters(uint32_t averageLength) noexcept;
+
+// throws std::invalid_argument unless 64 <= min <= average <= max
+void ValidateCdcParameters(const CdcParameters& parameters);
+
+// length of the first chunk of data
+size_t CdcChunkLength(std::string_view data, const CdcParameters& parameters) noexcept;
+
+} // filediff
+#endif // CDC_H
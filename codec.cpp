@@ -0,0 +1,271 @@
+#include <array>
+#include <climits>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#ifdef FILEDIFF_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FILEDIFF_WITH_ZSTD
+#include <zstd.h>
+#endif
+#ifdef FILEDIFF_WITH_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
+#include "codec.h"
+
+namespace {
+
+constexpr std::array<std::string_view, 4> CODEC_NAMES { "none", "zlib", "zstd", "lz4" };
+
+[[noreturn]] void ThrowCorrupted(std::string_view codec)
+{
+    throw std::runtime_error(fmt::format("Corrupted {} compressed literals!", codec));
+}
+
+#ifdef FILEDIFF_WITH_ZLIB
+class ZlibCodec : public filediff::Codec
+{
+public:
+    explicit ZlibCodec(int level)
+    {
+        if (deflateInit(&m_deflate, level == 0 ? Z_DEFAULT_COMPRESSION : level) != Z_OK) {
+            throw std::invalid_argument(fmt::format("Invalid zlib compression level {}!", level));
+        }
+        if (inflateInit(&m_inflate) != Z_OK) {
+            deflateEnd(&m_deflate);
+            throw std::runtime_error("zlib cannot be initialized!");
+        }
+    }
+
+    ~ZlibCodec() override
+    {
+        deflateEnd(&m_deflate);
+        inflateEnd(&m_inflate);
+    }
+
+    filediff::CodecType Type() const noexcept override
+    {
+        return filediff::CodecType::ZLIB;
+    }
+
+    void Compress(std::string_view data, std::string& out) override
+    {
+        if (data.size() > UINT_MAX) {
+            throw std::invalid_argument("Block too big for zlib!");
+        }
+        deflateReset(&m_deflate);
+        const auto offset { out.size() };
+        out.resize(offset + deflateBound(&m_deflate, static_cast<uLong>(data.size())));
+        m_deflate.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        m_deflate.avail_in = static_cast<uInt>(data.size());
+        m_deflate.next_out = reinterpret_cast<Bytef*>(out.data() + offset);
+        m_deflate.avail_out = static_cast<uInt>(out.size() - offset);
+        if (deflate(&m_deflate, Z_FINISH) != Z_STREAM_END) {
+            throw std::runtime_error("zlib compression failed!");
+        }
+        out.resize(offset + m_deflate.total_out);
+    }
+
+    void Decompress(std::string_view data, size_t originalSize, std::string& out) override
+    {
+        if (data.size() > UINT_MAX || originalSize > UINT_MAX) {
+            ThrowCorrupted("zlib");
+        }
+        inflateReset(&m_inflate);
+        out.resize(originalSize);
+        m_inflate.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        m_inflate.avail_in = static_cast<uInt>(data.size());
+        m_inflate.next_out = reinterpret_cast<Bytef*>(out.data());
+        m_inflate.avail_out = static_cast<uInt>(originalSize);
+        if (inflate(&m_inflate, Z_FINISH) != Z_STREAM_END || m_inflate.total_out != originalSize) {
+            ThrowCorrupted("zlib");
+        }
+    }
+
+private:
+    z_stream m_deflate {};
+    z_stream m_inflate {};
+};
+#endif
+
+#ifdef FILEDIFF_WITH_ZSTD
+class ZstdCodec : public filediff::Codec
+{
+public:
+    explicit ZstdCodec(int level)
+        : m_level { level == 0 ? ZSTD_CLEVEL_DEFAULT : level }
+        , m_compression { ZSTD_createCCtx() }
+        , m_decompression { ZSTD_createDCtx() }
+    {
+        if (!m_compression || !m_decompression) {
+            ZSTD_freeCCtx(m_compression);
+            ZSTD_freeDCtx(m_decompression);
+            throw std::runtime_error("zstd cannot be initialized!");
+        }
+        if (m_level < ZSTD_minCLevel() || m_level > ZSTD_maxCLevel()) {
+            ZSTD_freeCCtx(m_compression);
+            ZSTD_freeDCtx(m_decompression);
+            throw std::invalid_argument(fmt::format("Invalid zstd compression level {}!", level));
+        }
+    }
+
+    ~ZstdCodec() override
+    {
+        ZSTD_freeCCtx(m_compression);
+        ZSTD_freeDCtx(m_decompression);
+    }
+
+    filediff::CodecType Type() const noexcept override
+    {
+        return filediff::CodecType::ZSTD;
+    }
+
+    void Compress(std::string_view data, std::string& out) override
+    {
+        const auto offset { out.size() };
+        out.resize(offset + ZSTD_compressBound(data.size()));
+        const auto size { ZSTD_compressCCtx(m_compression, out.data() + offset, out.size() - offset, data.data(), data.size(), m_level) };
+        if (ZSTD_isError(size)) {
+            throw std::runtime_error(fmt::format("zstd compression failed: {}!", ZSTD_getErrorName(size)));
+        }
+        out.resize(offset + size);
+    }
+
+    void Decompress(std::string_view data, size_t originalSize, std::string& out) override
+    {
+        out.resize(originalSize);
+        const auto size { ZSTD_decompressDCtx(m_decompression, out.data(), originalSize, data.data(), data.size()) };
+        if (ZSTD_isError(size) || size != originalSize) {
+            ThrowCorrupted("zstd");
+        }
+    }
+
+private:
+    int m_level;
+    ZSTD_CCtx* m_compression;
+    ZSTD_DCtx* m_decompression;
+};
+#endif
+
+#ifdef FILEDIFF_WITH_LZ4
+// level 1 (and default) is the fast compressor, higher levels select the HC one
+class Lz4Codec : public filediff::Codec
+{
+public:
+    explicit Lz4Codec(int level)
+        : m_level { level == 0 ? 1 : level }
+    {
+        if (m_level < 1 || m_level > LZ4HC_CLEVEL_MAX) {
+            throw std::invalid_argument(fmt::format("Invalid lz4 compression level {}!", level));
+        }
+    }
+
+    filediff::CodecType Type() const noexcept override
+    {
+        return filediff::CodecType::LZ4;
+    }
+
+    void Compress(std::string_view data, std::string& out) override
+    {
+        if (data.size() > LZ4_MAX_INPUT_SIZE) {
+            throw std::invalid_argument("Block too big for lz4!");
+        }
+        const auto inputSize { static_cast<int>(data.size()) };
+        const auto offset { out.size() };
+        const auto bound { LZ4_compressBound(inputSize) };
+        out.resize(offset + static_cast<size_t>(bound));
+        const auto size { m_level == 1 ? LZ4_compress_default(data.data(), out.data() + offset, inputSize, bound)
+                                       : LZ4_compress_HC(data.data(), out.data() + offset, inputSize, bound, m_level) };
+        if (size <= 0 && inputSize > 0) {
+            throw std::runtime_error("lz4 compression failed!");
+        }
+        out.resize(offset + static_cast<size_t>(size));
+    }
+
+    void Decompress(std::string_view data, size_t originalSize, std::string& out) override
+    {
+        if (data.size() > INT_MAX || originalSize > INT_MAX) {
+            ThrowCorrupted("lz4");
+        }
+        out.resize(originalSize);
+        const auto size { LZ4_decompress_safe(data.data(), out.data(), static_cast<int>(data.size()), static_cast<int>(originalSize)) };
+        if (size < 0 || static_cast<size_t>(size) != originalSize) {
+            ThrowCorrupted("lz4");
+        }
+    }
+
+private:
+    int m_level;
+};
+#endif
+
+} // namespace
+
+bool filediff::IsCodecAvailable(CodecType type) noexcept
+{
+    switch (type) {
+    case CodecType::NONE:
+        return true;
+    case CodecType::ZLIB:
+#ifdef FILEDIFF_WITH_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    case CodecType::ZSTD:
+#ifdef FILEDIFF_WITH_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    case CodecType::LZ4:
+#ifdef FILEDIFF_WITH_LZ4
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+std::unique_ptr<filediff::Codec> filediff::MakeCodec(CodecType type, int level)
+{
+    switch (type) {
+    case CodecType::NONE:
+        return nullptr;
+#ifdef FILEDIFF_WITH_ZLIB
+    case CodecType::ZLIB:
+        return std::make_unique<ZlibCodec>(level);
+#endif
+#ifdef FILEDIFF_WITH_ZSTD
+    case CodecType::ZSTD:
+        return std::make_unique<ZstdCodec>(level);
+#endif
+#ifdef FILEDIFF_WITH_LZ4
+    case CodecType::LZ4:
+        return std::make_unique<Lz4Codec>(level);
+#endif
+    default:
+        throw std::runtime_error(fmt::format("Codec {} is not built in!", CodecName(type)));
+    }
+}
+
+std::optional<filediff::CodecType> filediff::CodecFromName(std::string_view name) noexcept
+{
+    for (size_t i { 0 }; i < CODEC_NAMES.size(); ++i) {
+        if (CODEC_NAMES[i] == name) {
+            return static_cast<CodecType>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+std::string_view filediff::CodecName(CodecType type) noexcept
+{
+    const auto index { static_cast<size_t>(type) };
+    return index < CODEC_NAMES.size() ? CODEC_NAMES[index] : "unknown";
+}
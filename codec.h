@@ -0,0 +1,45 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace filediff {
+
+// Compression of literal batches in binary delta. Libraries behind codecs are optional, a codec is built in only when
+// its library was found at configure time (FILEDIFF_WITH_ZLIB, FILEDIFF_WITH_ZSTD, FILEDIFF_WITH_LZ4).
+enum class CodecType : uint8_t {
+    NONE,
+    ZLIB,
+    ZSTD,
+    LZ4
+};
+
+class Codec
+{
+public:
+    virtual ~Codec() = default;
+
+    virtual CodecType Type() const noexcept = 0;
+
+    // every block is compressed independently, contexts are kept between blocks to avoid setting them up again
+    virtual void Compress(std::string_view data, std::string& out) = 0;
+
+    // out is resized to originalSize, throws if data is not a valid block of exactly that size
+    virtual void Decompress(std::string_view data, size_t originalSize, std::string& out) = 0;
+};
+
+bool IsCodecAvailable(CodecType type) noexcept;
+
+// level 0 stands for the default level of the codec, throws for codecs which are not built in
+std::unique_ptr<Codec> MakeCodec(CodecType type, int level = 0);
+
+// "none", "zlib", "zstd" or "lz4"
+std::optional<CodecType> CodecFromName(std::string_view name) noexcept;
+std::string_view CodecName(CodecType type) noexcept;
+
+} // filediff
+#endif // CODEC_H
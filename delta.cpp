@@ -1,83 +1,260 @@
 #include <algorithm>
-#include <fstream>
-#include <limits>
-#include <map>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <unordered_map>
+#include <vector>
 
 #include <fmt/core.h>
 
 #include "adler32.h"
+#include "alignment.h"
 #include "delta.h"
+#include "hashindex.h"
+#include "inputfile.h"
+#include "stats.h"
+#include "threadpool.h"
+#include "xxhash64.h"
 
-static auto ReadLine(std::ifstream& ifs, auto lineNumber)
+namespace {
+
+constexpr size_t ARENA_MIN_BLOCK_SIZE { 64 << 10 };
+
+// limit of data hashed ahead to be checked against one hash tree node
+constexpr size_t MAX_TREE_WINDOW { 64 << 20 };
+
+// data scanned by every thread in the first segment after hash tree confirmation stopped, see CalculateBlocks()
+constexpr size_t TREE_SCAN_SEGMENT { 256 << 10 };
+
+// strong hashes of consecutive blocks of data (all full ones), in parallel partitions with a pool
+void HashBlocks(std::string_view data, size_t blockSize, std::span<uint64_t> hashes, filediff::ThreadPool* pool)
 {
-    static auto lineCntr { 0U };
-    if (lineCntr >= lineNumber) {
-        if (ifs.eof()) {
-            ifs.clear();
+    auto hashRange = [=](size_t first, size_t last) {
+        for (auto block { first }; block < last; ++block) {
+            hashes[block] = filediff::xxhash64(data.substr(block * blockSize, blockSize));
         }
-        ifs.seekg(0); // reset file pointer to be able to read previous lines
-        lineCntr = 0;
+    };
+    const auto numberOfRanges { std::min(filediff::NumberOfPartitions(data.size(), pool), hashes.size()) };
+    if (numberOfRanges < 2) {
+        hashRange(0, hashes.size());
+        return;
     }
-
-    while (lineCntr < lineNumber) {
-        ifs.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-        lineCntr++;
+    std::vector<std::future<void>> results;
+    for (size_t i { 0 }; i < numberOfRanges; ++i) {
+        results.push_back(pool->Submit([=] { hashRange(hashes.size() * i / numberOfRanges, hashes.size() * (i + 1) / numberOfRanges); }));
+    }
+    for (auto& result : results) {
+        result.get();
     }
-    std::string line;
-    std::getline(ifs, line);
-    lineCntr++;
-
-    return line;
 }
 
+} // namespace
+
 filediff::Delta::Delta(std::string_view sigFileName, std::string_view dataFileName)
     : m_dataFileName { dataFileName }
-    , m_baseSignature { sigFileName, filediff::Signature::InputFileType::SIGNATURE }
+    , m_loadedSignature { std::in_place, sigFileName, filediff::Signature::InputFileType::SIGNATURE }
+    , m_baseSignature { *m_loadedSignature }
+    , m_arena { std::in_place, ARENA_MIN_BLOCK_SIZE }
+    , m_delta { std::in_place, &*m_arena }
 {
 }
 
-auto findMatchingHash(auto itBegin, auto itEnd, uint32_t hash)
+filediff::Delta::Delta(const Signature& baseSignature, std::span<const std::byte> data)
+    : m_dataBuffer { std::in_place, reinterpret_cast<const char*>(data.data()), data.size() }
+    , m_baseSignature { baseSignature }
+    , m_arena { std::in_place, ARENA_MIN_BLOCK_SIZE }
+    , m_delta { std::in_place, &*m_arena }
 {
-    return std::find_if(itBegin, itEnd, [hash](const auto& pair) {
-        return pair.hash == hash;
-    });
 }
 
-void filediff::Delta::Calculate()
+void filediff::Delta::UseArena(bool useArena) noexcept
 {
-    std::ifstream ifs { m_dataFileName.data() };
-    if (!ifs.is_open()) {
-        throw std::runtime_error(fmt::format("File {} not found!", m_dataFileName));
+    m_useArena = useArena;
+}
+
+void filediff::Delta::Calculate(MatchingEngine engine, ThreadPool* pool)
+{
+    Calculate([this](uint32_t hash, std::string_view chunk) { m_delta->emplace_back(hash, chunk); }, engine, pool);
+}
+
+void filediff::Delta::Calculate(const Sink& sink, MatchingEngine engine, ThreadPool* pool)
+{
+    const auto lineMode { m_baseSignature.GetMetadata().m_mode == Signature::ChunkingMode::LINE };
+    CalculateInstructions([&sink, lineMode](const Instruction& instruction) {
+        if (instruction.m_type == Instruction::Type::LITERAL) {
+            auto chunk { instruction.m_data };
+            if (lineMode && chunk.ends_with('\n')) {
+                chunk.remove_suffix(1);
+            }
+            sink(instruction.m_hash, chunk);
+        } else if (instruction.m_type == Instruction::Type::REMOVED) {
+            sink(instruction.m_hash, "");
+        }
+    },
+        engine, pool);
+}
+
+void filediff::Delta::CalculateInstructions(const InstructionSink& sink, MatchingEngine engine, ThreadPool* pool)
+{
+    // literals in m_delta are views into m_data so they have to be dropped before buffer is refilled, the arena
+    // holding them goes together with them
+    m_delta.reset();
+    m_arena.reset();
+    m_data = {};
+    m_dataFile.reset();
+    // a line costs 12 bytes of line table and a record 24, one upstream block sized after data file serves a typical
+    // run; the size is taken before reading since LINE mode fills the line table while the file is being read
+    std::error_code error;
+    const auto dataSize { m_dataBuffer ? m_dataBuffer->size() : std::filesystem::file_size(std::filesystem::path { m_dataFileName }, error) };
+    if (m_useArena) {
+        m_arena.emplace(std::max<size_t>(error ? 0 : dataSize / 2, ARENA_MIN_BLOCK_SIZE));
     }
+    m_delta.emplace(RunResource());
 
-    auto updatedFileMetadata = ParseDataFile(ifs);
-    auto oldHashes { m_baseSignature.GetHashes() };
-    auto lineToBeParsedMarker = std::cbegin(updatedFileMetadata);
-    std::vector<decltype(updatedFileMetadata)::const_iterator> matchingRangeMarkers;
-    auto it = std::cbegin(updatedFileMetadata);
+    m_sink = sink;
+    m_numberOfRecords = 0;
+    m_emitted = {};
+    if (m_baseSignature.GetMetadata().m_mode == Signature::ChunkingMode::BLOCK) {
+        ReadDataFile();
+        CalculateBlocks(pool);
+    } else if (m_baseSignature.GetMetadata().m_mode == Signature::ChunkingMode::CDC) {
+        ReadDataFile();
+        CalculateContentDefinedChunks();
+    } else {
+        CalculateLines(engine, pool);
+    }
+    Emit(Instruction::Type::END, 0, 0, m_data);
+    m_sink = nullptr;
+    FILEDIFF_STATS_ADD(COPIES, m_emitted.m_copies);
+    FILEDIFF_STATS_ADD(LITERALS, m_emitted.m_literals);
+    FILEDIFF_STATS_ADD(LITERAL_BYTES, m_emitted.m_literalBytes);
+    FILEDIFF_STATS_ADD(REMOVED, m_emitted.m_removed);
+}
 
-    auto insertingLambda = [&ifs](const auto& elem) { return std::make_pair(elem.hash, ReadLine(ifs, elem.linePos)); };
+const filediff::Signature::Metadata& filediff::Delta::GetSignatureMetadata() const noexcept
+{
+    return m_baseSignature.GetMetadata();
+}
+
+filediff::Delta::Sink filediff::Delta::StreamSink(std::ostream& ostream)
+{
+    return [&ostream](uint32_t hash, std::string_view chunk) {
+        ostream << std::hex << hash << "\n"
+                << chunk << "\n";
+    };
+}
+
+void filediff::Delta::Emit(Instruction::Type type, uint32_t hash, size_t baseChunk, std::string_view data)
+{
+    if (type == Instruction::Type::LITERAL || type == Instruction::Type::REMOVED) {
+        m_numberOfRecords++;
+    }
+    if (type == Instruction::Type::COPY) {
+        m_emitted.m_copies++;
+    } else if (type == Instruction::Type::LITERAL) {
+        m_emitted.m_literals++;
+        m_emitted.m_literalBytes += data.size();
+    } else if (type == Instruction::Type::REMOVED) {
+        m_emitted.m_removed++;
+    }
+    m_sink(Instruction { type, hash, baseChunk, data });
+}
+
+void filediff::Delta::CalculateLines(MatchingEngine engine, ThreadPool* pool)
+{
+    const auto lines { [&] {
+        FILEDIFF_STATS_PHASE("delta parsing");
+        return ParseDataFile(pool);
+    }() };
+    FILEDIFF_STATS_ADD(CHUNKS_HASHED, lines.m_hashes.size());
+    if (engine == MatchingEngine::PATIENCE) {
+        AlignLines(lines);
+        return;
+    }
+    FILEDIFF_STATS_PHASE("delta matching");
+    const std::span<const uint32_t> newHashes { lines.m_hashes };
+    const auto oldHashes { m_baseSignature.GetHashes() };
+    const auto endMarker { newHashes.size() };
+
+    // index is built lazily, files which differ only by appended or changed lines mostly match chunk right at 'from'
+    std::optional<HashIndex> index;
+
+    // returns position of the first chunk in updated file which is not before 'from' and matches 'hash' (or endMarker)
+    uint64_t lookups { 0 };
+    auto findWeakHash = [&](uint32_t hash, size_t from) -> size_t {
+        lookups++;
+        if (engine == MatchingEngine::LINEAR) {
+            const auto it { std::find(std::next(std::cbegin(newHashes), from), std::cend(newHashes), hash) };
+            return std::distance(std::cbegin(newHashes), it);
+        }
+        if (from < endMarker && newHashes[from] == hash) {
+            return from;
+        }
+        if (!index) {
+            index.emplace(newHashes);
+        }
+        const auto position { index->FindFrom(hash, static_cast<uint32_t>(from)) };
+        return position == HashIndex::NPOS ? endMarker : position;
+    };
+
+    auto lineAt = [&](size_t position) {
+        return lines.LineAt(m_data, position);
+    };
+
+    // with strong hashes in signature a weak match counts only if XXH64 of the line agrees too, the strong hash is
+    // computed just for lines which already passed the adler32 check
+    const auto strongHashes { m_baseSignature.GetStrongHashes() };
+    uint64_t collisions { 0 };
+    auto findMatchingChunk = [&](size_t oldChunk, size_t from) -> size_t {
+        auto position { findWeakHash(oldHashes[oldChunk], from) };
+        if (strongHashes.empty()) {
+            return position;
+        }
+        for (; position != endMarker; position = findWeakHash(oldHashes[oldChunk], position + 1)) {
+            auto line { lineAt(position) };
+            if (line.ends_with('\n')) {
+                line.remove_suffix(1);
+            }
+            if (xxhash64(line) == strongHashes[oldChunk]) {
+                break;
+            }
+            collisions++;
+        }
+        return position;
+    };
+
+    auto insertLines = [&](size_t first, size_t last) {
+        for (; first < last; ++first) {
+            Emit(Instruction::Type::LITERAL, newHashes[first], 0, lineAt(first));
+        }
+    };
+
+    size_t lineToBeParsedMarker { 0 };
+    std::vector<size_t> matchingRangeMarkers;
+    size_t it { 0 };
 
     for (auto i = 0U; i < oldHashes.size(); ++i) {
         auto keepIt = it;
-        it = findMatchingHash(it, std::cend(updatedFileMetadata), oldHashes[i]);
+        it = findMatchingChunk(i, it);
 
-        if (it == std::cend(updatedFileMetadata)) {
+        if (it == endMarker) {
             // chunk not found in new version of the file is considered as removed
-            m_delta.emplace_back(oldHashes[i], "");
+            Emit(Instruction::Type::REMOVED, oldHashes[i], i, "");
             it = keepIt;
             continue;
         }
 
-        // TODO: checking here only next element after the one suspected that was removed but found in other place in
-        //       the file is not exactly perfect approach, what should be done here is to check if any of the elements
-        //       in range (oldHashes[i+1], oldHashes[value of it]] still persists new file (which meeans in range
-        //       [keepIt, it) in updatedFileMetadata), if so then 'it' should point to that matching element and all
-        //       preceding elements (from oldHashes) shall be considered as removed -> it's not a bug but it could be improved
-        auto iter = findMatchingHash(keepIt, std::cend(updatedFileMetadata), oldHashes[i + 1]);
-        if (std::distance(std::cbegin(updatedFileMetadata), iter) < std::distance(std::cbegin(updatedFileMetadata), it)) {
+        // only the chunk following the removed one is checked here, which is cheap but not optimal when several
+        // chunks in range (oldHashes[i+1], oldHashes[value of it]] persist, PATIENCE engine aligns whole sequences instead
+        // when chunk matched right at 'keepIt' nothing can be found before it so the lookup is skipped
+        const auto iter { it != keepIt && i + 1 < oldHashes.size() ? findMatchingChunk(i + 1, keepIt) : endMarker };
+        if (iter < it) {
             // this means 'it' should be considered as deleted and the fact it was found means there were more such chunks in the file
-            m_delta.emplace_back(oldHashes[i], "");
+            Emit(Instruction::Type::REMOVED, oldHashes[i], i, "");
             it = keepIt;
             continue;
         }
@@ -87,54 +264,550 @@ void filediff::Delta::Calculate()
 
         if (matchingRangeMarkers.size() == 1) {
             // insert new elements prefacing matching chunks
-            std::transform(lineToBeParsedMarker, matchingRangeMarkers[0], std::back_inserter(m_delta), insertingLambda);
-            lineToBeParsedMarker = std::next(matchingRangeMarkers[0]);
+            insertLines(lineToBeParsedMarker, matchingRangeMarkers[0]);
+            Emit(Instruction::Type::COPY, oldHashes[i], i, lineAt(matchingRangeMarkers[0]));
+            lineToBeParsedMarker = matchingRangeMarkers[0] + 1;
         } else if (matchingRangeMarkers.size() == 2) {
             // insert new elements from matching chunks "block"
-            std::transform(std::next(matchingRangeMarkers[0]), matchingRangeMarkers[1], std::back_inserter(m_delta),
-                insertingLambda);
-            lineToBeParsedMarker = std::next(matchingRangeMarkers[1]);
+            insertLines(matchingRangeMarkers[0] + 1, matchingRangeMarkers[1]);
+            Emit(Instruction::Type::COPY, oldHashes[i], i, lineAt(matchingRangeMarkers[1]));
+            lineToBeParsedMarker = matchingRangeMarkers[1] + 1;
             matchingRangeMarkers.clear();
         }
     }
     // insert all remaining chunks not matching old hashes
-    std::transform(lineToBeParsedMarker, std::cend(updatedFileMetadata), std::back_inserter(m_delta), insertingLambda);
+    insertLines(lineToBeParsedMarker, endMarker);
+    FILEDIFF_STATS_ADD(HASH_LOOKUPS, lookups);
+    FILEDIFF_STATS_ADD(COLLISIONS, collisions);
+}
+
+void filediff::Delta::AlignLines(const LineTable& lines)
+{
+    FILEDIFF_STATS_PHASE("delta matching");
+    const std::span<const uint32_t> newHashes { lines.m_hashes };
+    const auto oldHashes { m_baseSignature.GetHashes() };
+    const auto strongHashes { m_baseSignature.GetStrongHashes() };
+
+    auto lineAt = [&](size_t position) {
+        return lines.LineAt(m_data, position);
+    };
+    auto strongHashAt = [&](size_t position) {
+        auto line { lineAt(position) };
+        if (line.ends_with('\n')) {
+            line.remove_suffix(1);
+        }
+        return xxhash64(line);
+    };
+
+    uint64_t collisions { 0 };
+    auto sameLine = [&](size_t oldChunk, size_t position) {
+        if (strongHashes.empty() || strongHashAt(position) == strongHashes[oldChunk]) {
+            return true;
+        }
+        collisions++;
+        return false;
+    };
+    const auto aligned { PatienceAlign(oldHashes, newHashes, sameLine) };
+
+    // lines left out of the alignment are looked up anywhere in base file, the ones found there were moved and become
+    // copies, base lines neither aligned nor moved are the removed ones
+    std::pmr::vector<bool> reused(oldHashes.size(), false, RunResource());
+    std::pmr::vector<uint32_t> sources(newHashes.size(), HashIndex::NPOS, RunResource());
+    for (const auto& [oldChunk, position] : aligned) {
+        reused[oldChunk] = true;
+        sources[position] = static_cast<uint32_t>(oldChunk);
+    }
+    uint64_t lookups { 0 };
+    if (aligned.size() < newHashes.size()) {
+        const HashIndex index { oldHashes };
+        // candidates of every hash before its cursor are all reused, so repeated lines are not scanned over again
+        std::pmr::unordered_map<uint32_t, size_t> cursors { RunResource() };
+        for (size_t position { 0 }; position < newHashes.size(); ++position) {
+            if (sources[position] != HashIndex::NPOS) {
+                continue;
+            }
+            lookups++;
+            const auto candidates { index.Find(newHashes[position]) };
+            if (candidates.empty()) {
+                continue;
+            }
+            const auto strongHash { strongHashes.empty() ? 0 : strongHashAt(position) };
+            auto sameContent = [&](size_t candidate) {
+                if (strongHashes.empty() || strongHashes[candidate] == strongHash) {
+                    return true;
+                }
+                collisions++;
+                return false;
+            };
+            // a base line not reused yet is preferred, so that fewer base lines end up removed, else the first one
+            auto& cursor { cursors[newHashes[position]] };
+            while (cursor < candidates.size() && reused[candidates[cursor]]) {
+                cursor++;
+            }
+            for (auto i { cursor }; i < candidates.size() && sources[position] == HashIndex::NPOS; ++i) {
+                if (!reused[candidates[i]] && sameContent(candidates[i])) {
+                    sources[position] = candidates[i];
+                }
+            }
+            for (auto i { size_t { 0 } }; i < candidates.size() && sources[position] == HashIndex::NPOS; ++i) {
+                if (sameContent(candidates[i])) {
+                    sources[position] = candidates[i];
+                }
+            }
+            if (sources[position] != HashIndex::NPOS) {
+                reused[sources[position]] = true;
+            }
+        }
+    }
+
+    size_t oldChunk { 0 };
+    size_t position { 0 };
+    auto emitUntil = [&](size_t oldEnd, size_t newEnd) {
+        for (; oldChunk < oldEnd; ++oldChunk) {
+            if (!reused[oldChunk]) {
+                Emit(Instruction::Type::REMOVED, oldHashes[oldChunk], oldChunk, "");
+            }
+        }
+        for (; position < newEnd; ++position) {
+            if (sources[position] == HashIndex::NPOS) {
+                Emit(Instruction::Type::LITERAL, newHashes[position], 0, lineAt(position));
+            } else {
+                // moved line changes the file even though no new content is needed for it
+                m_numberOfRecords++;
+                Emit(Instruction::Type::COPY, newHashes[position], sources[position], lineAt(position));
+            }
+        }
+    };
+    for (const auto& [alignedChunk, alignedPosition] : aligned) {
+        emitUntil(alignedChunk, alignedPosition);
+        Emit(Instruction::Type::COPY, oldHashes[alignedChunk], alignedChunk, lineAt(alignedPosition));
+        oldChunk = alignedChunk + 1;
+        position = alignedPosition + 1;
+    }
+    emitUntil(oldHashes.size(), newHashes.size());
+    FILEDIFF_STATS_ADD(HASH_LOOKUPS, lookups);
+    FILEDIFF_STATS_ADD(COLLISIONS, collisions);
+}
+
+void filediff::Delta::CalculateBlocks(ThreadPool* pool)
+{
+    FILEDIFF_STATS_PHASE("delta matching");
+    const auto& metadata { m_baseSignature.GetMetadata() };
+    const auto weakHashes { m_baseSignature.GetHashes() };
+    const auto strongHashes { m_baseSignature.GetStrongHashes() };
+    const size_t blockSize { metadata.m_chunkLenght };
+    const auto numberOfBlocks { weakHashes.size() };
+    // last block is shorter if file size is not a multiple of block size, it can only match the end of updated file
+    const auto lastBlockSize { numberOfBlocks == 0 ? 0 : metadata.m_fileSize - (numberOfBlocks - 1) * blockSize };
+    const auto numberOfFullBlocks { lastBlockSize == blockSize ? numberOfBlocks : numberOfBlocks - 1 };
+
+    const HashIndex index { weakHashes };
+    std::vector<bool> matched(numberOfBlocks, false);
+    const auto data { m_data };
+
+    auto insertLiteral = [this](std::string_view literal) {
+        if (!literal.empty()) {
+            Emit(Instruction::Type::LITERAL, RollingAdler32 { literal }.Digest(), 0, literal);
+        }
+    };
+
+    // strong hash of a window is computed only when its weak hash matches at least one full block
+    auto hasCandidate = [&](uint32_t weakHash) {
+        const auto candidates { index.Find(weakHash) };
+        return !candidates.empty() && candidates.front() < numberOfFullBlocks; // positions are sorted ascending
+    };
+
+    // returns index of full block with given hashes (preferring 'expected' if there are more such blocks), or NPOS
+    auto selectBlock = [&](uint32_t weakHash, uint64_t strongHash, size_t expected) -> size_t {
+        size_t found { HashIndex::NPOS };
+        for (const auto candidate : index.Find(weakHash)) {
+            if (candidate < numberOfFullBlocks && strongHashes[candidate] == strongHash) {
+                found = candidate;
+                if (candidate == expected) {
+                    break;
+                }
+            }
+        }
+        return found;
+    };
+
+    size_t literalStart { 0 };
+    size_t position { 0 };
+    size_t expectedBlock { 0 };
+    auto acceptMatch = [&](size_t offset, size_t block) {
+        insertLiteral(data.substr(literalStart, offset - literalStart));
+        Emit(Instruction::Type::COPY, weakHashes[block], block, data.substr(offset, blockSize));
+        matched[block] = true;
+        expectedBlock = block + 1;
+        position = offset + blockSize;
+        literalStart = position;
+    };
+
+    // With hash tree, blocks following the last match (or the beginning of data) are first checked as a whole: strong
+    // hashes of a window of data blocks are combined the same way as the tree, an equal node confirms all blocks under
+    // it and only differing nodes are descended into, down to the first differing block where scanning resumes. Window
+    // is an aligned tree node no larger than the run confirmed since the last difference (at least one node of level
+    // 1), so hashing ahead of a difference costs at most as much as the blocks confirmed before it. A block confirmed
+    // this way is the one scanning would pick at that offset, so the delta does not depend on the tree.
+    const auto treeHeight { m_baseSignature.GetTreeHeight() };
+    const size_t fanout { metadata.m_treeFanout };
+    size_t confirmedRun { 0 };
+    std::vector<std::vector<uint64_t>> window; // data hashes of the window, level 0 being strong hashes of its blocks
+    auto confirmBlocks = [&]() {
+        while (treeHeight > 0 && expectedBlock < numberOfFullBlocks) {
+            const auto first { expectedBlock };
+            size_t level { 0 };
+            size_t span { 1 };
+            while (level < treeHeight && first % (span * fanout) == 0 && span * fanout * blockSize <= MAX_TREE_WINDOW
+                && (level == 0 || span * fanout <= confirmedRun)) {
+                span *= fanout;
+                level++;
+            }
+            const auto last { std::min({ first + span, numberOfFullBlocks, first + (data.size() - position) / blockSize }) };
+            if (level == 0 || last == first) {
+                return;
+            }
+
+            window.resize(level + 1);
+            window[0].resize(last - first);
+            HashBlocks(data.substr(position, (last - first) * blockSize), blockSize, window[0], pool);
+            for (size_t i { 1 }; i <= level; ++i) {
+                window[i].clear();
+                for (size_t child { 0 }; child < window[i - 1].size(); child += fanout) {
+                    window[i].push_back(TreeNodeHash(std::span { window[i - 1] }.subspan(child, std::min<size_t>(fanout, window[i - 1].size() - child))));
+                }
+            }
+
+            // blocks of the node confirmed in order up to the first differing one; a node reaching past the window
+            // (cut by the end of data or by the last, shorter block) is never compared as a whole
+            auto confirmNode = [&](auto& self, size_t nodeLevel, size_t nodeSpan, size_t node) -> size_t {
+                const auto nodeFirst { node * nodeSpan };
+                const auto nodeLast { std::min(nodeFirst + nodeSpan, numberOfBlocks) };
+                if (nodeLast <= last && window[nodeLevel][nodeFirst / nodeSpan - first / nodeSpan] == m_baseSignature.GetTreeLevel(nodeLevel)[node]) {
+                    return nodeLast - nodeFirst;
+                }
+                if (nodeLevel == 0) {
+                    return 0;
+                }
+                size_t confirmed { 0 };
+                const auto childSpan { nodeSpan / fanout };
+                for (auto child { node * fanout }; child * childSpan < std::min(nodeLast, last); ++child) {
+                    const auto childConfirmed { self(self, nodeLevel - 1, childSpan, child) };
+                    confirmed += childConfirmed;
+                    if (childConfirmed < std::min(child * childSpan + childSpan, numberOfBlocks) - child * childSpan) {
+                        break;
+                    }
+                }
+                return confirmed;
+            };
+            const auto confirmed { confirmNode(confirmNode, level, span, first / span) };
+            for (auto block { first }; block < first + confirmed; ++block) {
+                acceptMatch(position, block);
+            }
+            FILEDIFF_STATS_ADD(TREE_CONFIRMED_BLOCKS, confirmed);
+            confirmedRun = confirmed < last - first ? 0 : confirmedRun + confirmed;
+            if (confirmedRun == 0) {
+                return;
+            }
+        }
+    };
+
+    const auto numberOfWindows { blockSize <= data.size() && numberOfFullBlocks > 0 ? data.size() - blockSize + 1 : 0 };
+    const auto numberOfRanges { NumberOfPartitions(numberOfWindows, pool) };
+    if (numberOfRanges > 1) {
+        // every window in range [first, last) is checked concurrently, candidates are then merged in file order the same
+        // way as serial loop below would pick them: first one not overlapping previous match wins
+        struct Candidate {
+            size_t offset;
+            uint32_t weakHash;
+            uint64_t strongHash;
+        };
+        auto scanRange = [&](size_t first, size_t last) {
+            std::vector<Candidate> candidates;
+            uint64_t collisions { 0 };
+            RollingAdler32 rolling { data.substr(first, blockSize) };
+            for (auto offset { first }; offset < last; ++offset) {
+                const auto weakHash { rolling.Digest() };
+                if (hasCandidate(weakHash)) {
+                    const auto strongHash { xxhash64(data.substr(offset, blockSize)) };
+                    if (selectBlock(weakHash, strongHash, HashIndex::NPOS) != HashIndex::NPOS) {
+                        candidates.emplace_back(offset, weakHash, strongHash);
+                    } else {
+                        collisions++;
+                    }
+                }
+                if (offset + 1 < last) {
+                    rolling.Roll(data[offset], data[offset + blockSize]);
+                }
+            }
+            FILEDIFF_STATS_ADD(HASH_LOOKUPS, last - first);
+            FILEDIFF_STATS_ADD(COLLISIONS, collisions);
+            return candidates;
+        };
+
+        // Without tree all windows form one segment. With it windows are scanned in segments starting where tree
+        // confirmation stopped and it is tried again after every match, as in the serial loop; candidates skipped by
+        // it were scanned in vain, so a segment following a match is small and it doubles while nothing matches.
+        const auto firstSegment { treeHeight > 0 ? numberOfRanges * std::max(blockSize, TREE_SCAN_SEGMENT) : numberOfWindows };
+        auto segment { firstSegment };
+        confirmBlocks();
+        for (auto begin { position }; begin < numberOfWindows;) {
+            const auto end { std::min(numberOfWindows, begin + segment) };
+            std::vector<std::future<std::vector<Candidate>>> results;
+            for (size_t i { 0 }; i < numberOfRanges; ++i) {
+                const auto first { begin + (end - begin) * i / numberOfRanges };
+                const auto last { begin + (end - begin) * (i + 1) / numberOfRanges };
+                if (first < last) {
+                    results.push_back(pool->Submit([&scanRange, first, last] { return scanRange(first, last); }));
+                }
+            }
+            auto matchedInSegment { false };
+            for (auto& result : results) {
+                for (const auto& candidate : result.get()) {
+                    if (candidate.offset >= position) {
+                        acceptMatch(candidate.offset, selectBlock(candidate.weakHash, candidate.strongHash, expectedBlock));
+                        confirmBlocks();
+                        matchedInSegment = true;
+                    }
+                }
+            }
+            begin = std::max(end, position);
+            segment = matchedInSegment ? firstSegment : std::min(segment * 2, numberOfWindows);
+        }
+    } else if (numberOfWindows > 0) {
+        uint64_t lookups { 0 };
+        uint64_t collisions { 0 };
+        confirmBlocks();
+        RollingAdler32 rolling { data.substr(position, blockSize) };
+        while (position + blockSize <= data.size()) {
+            const auto weakHash { rolling.Digest() };
+            lookups++;
+            const auto candidate { hasCandidate(weakHash) };
+            const auto block { candidate ? selectBlock(weakHash, xxhash64(data.substr(position, blockSize)), expectedBlock) : HashIndex::NPOS };
+            collisions += candidate && block == HashIndex::NPOS;
+            if (block != HashIndex::NPOS) {
+                acceptMatch(position, block);
+                confirmBlocks();
+                if (position + blockSize > data.size()) {
+                    break;
+                }
+                rolling = RollingAdler32 { data.substr(position, blockSize) };
+                continue;
+            }
+
+            if (position + blockSize >= data.size()) {
+                break;
+            }
+            rolling.Roll(data[position], data[position + blockSize]);
+            position++;
+        }
+        FILEDIFF_STATS_ADD(HASH_LOOKUPS, lookups);
+        FILEDIFF_STATS_ADD(COLLISIONS, collisions);
+    }
+
+    // remaining tail can still match the last, shorter block of the base file
+    if (numberOfFullBlocks < numberOfBlocks && data.size() >= literalStart + lastBlockSize) {
+        const auto tail { data.substr(data.size() - lastBlockSize) };
+        const auto lastBlock { numberOfBlocks - 1 };
+        if (RollingAdler32 { tail }.Digest() == weakHashes[lastBlock] && xxhash64(tail) == strongHashes[lastBlock]) {
+            insertLiteral(data.substr(literalStart, data.size() - lastBlockSize - literalStart));
+            Emit(Instruction::Type::COPY, weakHashes[lastBlock], lastBlock, tail);
+            matched[lastBlock] = true;
+            literalStart = data.size();
+        }
+    }
+    insertLiteral(data.substr(literalStart));
+
+    // blocks of base file not found anywhere in updated file are considered as removed
+    for (size_t i { 0 }; i < numberOfBlocks; ++i) {
+        if (!matched[i]) {
+            Emit(Instruction::Type::REMOVED, weakHashes[i], i, "");
+        }
+    }
+}
+
+void filediff::Delta::CalculateContentDefinedChunks()
+{
+    FILEDIFF_STATS_PHASE("delta matching");
+    const auto parameters { m_baseSignature.GetMetadata().GetCdcParameters() };
+    const auto weakHashes { m_baseSignature.GetHashes() };
+    const auto strongHashes { m_baseSignature.GetStrongHashes() };
+    const HashIndex index { weakHashes };
+    std::vector<bool> matched(weakHashes.size(), false);
+
+    // boundaries of updated file resynchronize with the base ones right after an edit, so chunks are only looked up,
+    // unmatched chunks next to each other form a single literal
+    ChunkReader reader { m_data };
+    size_t literalStart { 0 };
+    size_t expectedChunk { 0 };
+    uint64_t chunks { 0 };
+    uint64_t collisions { 0 };
+    while (const auto chunk { reader.NextChunk(parameters) }) {
+        chunks++;
+        const auto offset { reader.Position() - chunk->size() };
+        const auto weakHash { adler32(*chunk) };
+        const auto candidates { index.Find(weakHash) };
+        if (candidates.empty()) {
+            continue;
+        }
+
+        const auto strongHash { xxhash64(*chunk) };
+        size_t found { HashIndex::NPOS };
+        for (const auto candidate : candidates) {
+            if (strongHashes[candidate] == strongHash) {
+                found = candidate;
+                if (candidate == expectedChunk) {
+                    break;
+                }
+            }
+        }
+        if (found == HashIndex::NPOS) {
+            collisions++;
+            continue;
+        }
+
+        if (offset > literalStart) {
+            const auto literal { m_data.substr(literalStart, offset - literalStart) };
+            Emit(Instruction::Type::LITERAL, adler32(literal), 0, literal);
+        }
+        Emit(Instruction::Type::COPY, weakHashes[found], found, *chunk);
+        matched[found] = true;
+        expectedChunk = found + 1;
+        literalStart = reader.Position();
+    }
+    if (literalStart < m_data.size()) {
+        const auto literal { m_data.substr(literalStart) };
+        Emit(Instruction::Type::LITERAL, adler32(literal), 0, literal);
+    }
+    FILEDIFF_STATS_ADD(CHUNKS_HASHED, chunks);
+    FILEDIFF_STATS_ADD(HASH_LOOKUPS, chunks);
+    FILEDIFF_STATS_ADD(COLLISIONS, collisions);
+
+    // chunks of base file not found anywhere in updated file are considered as removed
+    for (size_t i { 0 }; i < weakHashes.size(); ++i) {
+        if (!matched[i]) {
+            Emit(Instruction::Type::REMOVED, weakHashes[i], i, "");
+        }
+    }
 }
 
 bool filediff::Delta::IsChanged() const noexcept
 {
-    return m_delta.size();
+    return m_numberOfRecords;
 }
 
 void filediff::Delta::SerializeDelta(std::ostream& ostream) const
 {
     if (IsChanged()) {
-        for (const auto& elem : m_delta) {
-            ostream << std::hex << elem.first << "\n"
-                    << elem.second << "\n";
+        const auto sink { StreamSink(ostream) };
+        for (const auto& elem : *m_delta) {
+            sink(elem.first, elem.second);
         }
     }
 }
 
-const std::deque<std::pair<uint32_t, std::string>>& filediff::Delta::GetRawDelta() const noexcept
+const std::pmr::vector<std::pair<uint32_t, std::string_view>>& filediff::Delta::GetRawDelta() const noexcept
 {
-    return m_delta;
+    return *m_delta;
 }
 
-std::deque<filediff::Delta::LineMetadata> filediff::Delta::ParseDataFile(std::ifstream& ifs)
+void filediff::Delta::ReadDataFile(const std::function<void(std::string_view)>& onRead)
 {
-    std::string line;
-    auto lineCounter { 0U };
-    std::deque<LineMetadata> metadata;
-    while (std::getline(ifs, line)) {
-        auto hash { adler32(line) };
-        metadata.emplace_back(hash, lineCounter++);
+    // whole file is mapped (or read into memory when it is processed during reading) at once, every chunk is later
+    // served as a view into it; data given in memory is used in place
+    if (m_dataBuffer) {
+        m_data = *m_dataBuffer;
+        if (onRead) {
+            onRead(m_data);
+        }
+        return;
+    }
+    if (onRead) {
+        m_dataFile.emplace(m_dataFileName, onRead);
+    } else {
+        m_dataFile.emplace(m_dataFileName);
     }
+    m_data = m_dataFile->Data();
+}
 
-    if (ifs.eof()) {
-        ifs.clear();
+filediff::Delta::LineTable filediff::Delta::ParseDataFile(ThreadPool* pool)
+{
+    // lines of every partition are hashed independently, offsets are kept relative to the beginning of data
+    auto parsePartition = [](LineTable& lines, std::string_view partition, size_t base) {
+        ChunkReader reader { partition };
+        auto offset { reader.Position() };
+        while (const auto line { reader.NextLine() }) {
+            lines.m_hashes.push_back(adler32(*line));
+            lines.m_offsets.push_back(base + offset);
+            offset = reader.Position();
+        }
+    };
+
+    // complete lines are parsed as soon as they are read, on the pool into heap tables copied into the arena one
+    // at the end (arena is not thread safe), otherwise right away while the following pieces are being read
+    LineTable lines { RunResource() };
+    std::vector<std::future<LineTable>> results;
+    size_t parsed { 0 };
+    size_t searched { 0 }; // data before it has no line terminator after parsed, only newly read data is searched
+    auto parseAvailable = [&](std::string_view data, bool last) {
+        const auto newline { last ? std::string_view::npos : data.substr(searched).rfind('\n') };
+        const auto end { last ? data.size() : newline == std::string_view::npos ? parsed : searched + newline + 1 };
+        searched = data.size();
+        const auto available { data.substr(parsed, end - parsed) };
+        parsed = end;
+        if (available.empty()) {
+            return;
+        }
+        const auto numberOfPartitions { NumberOfPartitions(available.size(), pool) };
+        if (numberOfPartitions < 2 && results.empty()) {
+            parsePartition(lines, available, static_cast<size_t>(available.data() - data.data()));
+            return;
+        }
+        for (const auto partition : SplitIntoPartitions(available, numberOfPartitions)) {
+            const auto base { static_cast<size_t>(partition.data() - data.data()) };
+            results.push_back(pool->Submit([&parsePartition, partition, base] {
+                LineTable partitionLines { std::pmr::new_delete_resource() };
+                parsePartition(partitionLines, partition, base);
+                return partitionLines;
+            }));
+        }
+    };
+    std::vector<LineTable> partitions;
+    size_t numberOfLines { lines.m_hashes.size() };
+    try {
+        ReadDataFile([&](std::string_view data) { parseAvailable(data, false); });
+        parseAvailable(m_data, true);
+        for (auto& result : results) {
+            partitions.push_back(result.get());
+            numberOfLines += partitions.back().m_hashes.size();
+        }
+    } catch (...) {
+        // queued tasks refer to parsePartition and to the data being read, none may outlive them
+        for (auto& result : results) {
+            if (result.valid()) {
+                result.wait();
+            }
+        }
+        throw;
     }
-    ifs.seekg(0);
+    lines.m_hashes.reserve(numberOfLines);
+    lines.m_offsets.reserve(numberOfLines + 1);
+    for (const auto& partition : partitions) {
+        lines.m_hashes.insert(std::end(lines.m_hashes), std::cbegin(partition.m_hashes), std::cend(partition.m_hashes));
+        lines.m_offsets.insert(std::end(lines.m_offsets), std::cbegin(partition.m_offsets), std::cend(partition.m_offsets));
+    }
+    lines.m_offsets.push_back(m_data.size());
+
+    return lines;
+}
 
-    return metadata;
+std::pmr::memory_resource* filediff::Delta::RunResource() noexcept
+{
+    return m_arena ? &*m_arena : std::pmr::new_delete_resource();
+}
+
+std::string_view filediff::Delta::LineTable::LineAt(std::string_view data, size_t line) const noexcept
+{
+    // line together with its terminator, so that instructions cover the updated file byte by byte
+    return data.substr(m_offsets[line], m_offsets[line + 1] - m_offsets[line]);
 }
@@ -1,10 +1,16 @@
 #ifndef DELTA_HPP
 #define DELTA_HPP
 
-#include <deque>
+#include <cstddef>
+#include <functional>
+#include <memory_resource>
+#include <optional>
+#include <span>
 #include <string_view>
 #include <utility>
+#include <vector>
 
+#include "inputfile.h"
 #include "signature.h"
 
 namespace filediff {
@@ -12,29 +18,126 @@ namespace filediff {
 class Delta
 {
 public:
+    enum class MatchingEngine {
+        INDEXED, // chunk lookups go through a hash index built over updated file, close to linear in file size
+        LINEAR, // reference implementation scanning updated file for every old chunk, O(old chunks * new chunks)
+        PATIENCE // aligns both line sequences by patience diff (see alignment.h), lines moved elsewhere become copies
+    };
+
+    // receives delta records (chunk hash, chunk content or empty view for removed chunk) as soon as they are final;
+    // chunk views stay valid until the next Calculate() call or until Delta is destroyed
+    using Sink = std::function<void(uint32_t hash, std::string_view chunk)>;
+
+    // One step of rebuilding updated file from the base one. COPY and LITERAL instructions come in the order of
+    // updated file and together cover it completely, REMOVED ones are interleaved, END comes last.
+    struct Instruction {
+        enum class Type {
+            COPY, // base chunk m_baseChunk is reused, m_data is its content as found in updated file
+            LITERAL, // m_data is new content not found in base file
+            REMOVED, // base chunk m_baseChunk is not reused at that place
+            END // m_data is the whole updated file
+        };
+
+        Type m_type;
+        uint32_t m_hash;
+        size_t m_baseChunk;
+        std::string_view m_data; // in LINE mode chunks include line terminator (if present)
+    };
+
+    using InstructionSink = std::function<void(const Instruction& instruction)>;
+
     Delta(std::string_view sigFileName, std::string_view dataFileName);
 
-    void Calculate();
+    // delta of data already in memory against a signature held by the caller; neither is copied, both have to outlive
+    // Delta (and data also the chunk views handed to sinks)
+    Delta(const Signature& baseSignature, std::span<const std::byte> data);
+
+    // base signature may be the loaded one owned by this object, a copy or a moved-to object would refer to it
+    Delta(const Delta&) = delete;
+    Delta& operator=(const Delta&) = delete;
+    Delta(Delta&&) = delete;
+    Delta& operator=(Delta&&) = delete;
+
+    // per run storage comes from an arena by default; without it every container allocates from the heap on its
+    // own, the baseline the arena is measured against; applies from the next run on
+    void UseArena(bool useArena) noexcept;
+
+    // INDEXED and LINEAR engines produce exactly the same delta, they differ only in the cost of finding matching chunks;
+    // PATIENCE keeps the longest common run of lines in place and looks up remaining lines anywhere in the base file,
+    // so reordered lines are reused instead of being removed and added again and only unused base lines are removed;
+    // engine applies to LINE mode signatures, BLOCK mode always slides a rolling checksum over the indexed blocks and
+    // CDC mode cuts data file into content-defined chunks with the parameters of signature and looks them up;
+    // with a pool data file is hashed (and in BLOCK mode also scanned for matches) in parallel partitions, the delta
+    // is still exactly the same as the one calculated serially
+    void Calculate(MatchingEngine engine = MatchingEngine::INDEXED, ThreadPool* pool = nullptr);
+
+    // streaming variant, records are passed to the sink instead of being collected for SerializeDelta()
+    void Calculate(const Sink& sink, MatchingEngine engine = MatchingEngine::INDEXED, ThreadPool* pool = nullptr);
+
+    // lowest level streaming variant giving also the information about reused chunks (needed by binary format)
+    void CalculateInstructions(const InstructionSink& sink, MatchingEngine engine = MatchingEngine::INDEXED, ThreadPool* pool = nullptr);
+
+    // sink writing records in the same text format as SerializeDelta()
+    static Sink StreamSink(std::ostream& ostream);
+
+    const Signature::Metadata& GetSignatureMetadata() const noexcept;
 
     void SerializeDelta(std::ostream& ostream) const;
 
     bool IsChanged() const noexcept;
 
 protected:
-    const std::deque<std::pair<uint32_t, std::string>>& GetRawDelta() const noexcept;
+    const std::pmr::vector<std::pair<uint32_t, std::string_view>>& GetRawDelta() const noexcept;
 
 private:
-    struct LineMetadata {
-        uint32_t hash;
-        uint32_t linePos;
+    // lines of data file kept as parallel arrays, matching walks only the hashes
+    struct LineTable {
+        explicit LineTable(std::pmr::memory_resource* resource)
+            : m_hashes { resource }
+            , m_offsets { resource }
+        {
+        }
+
+        std::pmr::vector<uint32_t> m_hashes;
+        std::pmr::vector<size_t> m_offsets; // in bytes from the beginning of m_data, one more entry marking the end of data
+
+        std::string_view LineAt(std::string_view data, size_t line) const noexcept;
     };
 
-    std::deque<LineMetadata> ParseDataFile(std::ifstream& ifs);
+    // onRead gets data read so far while the file is being read, see InputFile
+    void ReadDataFile(const std::function<void(std::string_view)>& onRead = nullptr);
+    // reads data file and hashes its lines
+    LineTable ParseDataFile(ThreadPool* pool);
+
+    // arena of the current run if it has one, otherwise the heap
+    std::pmr::memory_resource* RunResource() noexcept;
+
+    void Emit(Instruction::Type type, uint32_t hash, size_t baseChunk, std::string_view data);
+
+    void CalculateLines(MatchingEngine engine, ThreadPool* pool);
+    void AlignLines(const LineTable& lines);
+    void CalculateBlocks(ThreadPool* pool);
+    void CalculateContentDefinedChunks();
 
     std::string_view m_dataFileName; // this might be suspicious but the lifetime of orginal string is enough to not end up with dangling pointers.
-    Signature m_baseSignature;
-    std::deque<uint32_t> m_newHashes;
-    std::deque<std::pair<uint32_t, std::string>> m_delta;
+    std::optional<std::string_view> m_dataBuffer; // data given in memory instead of data file
+    std::optional<Signature> m_loadedSignature; // read from signature file, not set when signature is borrowed
+    const Signature& m_baseSignature;
+    std::optional<InputFile> m_dataFile;
+    std::string_view m_data; // content of data file, literals in m_delta point into it
+    // per run storage (line table, collected records) is carved from large blocks and released at once by the next run
+    std::optional<std::pmr::monotonic_buffer_resource> m_arena;
+    bool m_useArena { true };
+    std::optional<std::pmr::vector<std::pair<uint32_t, std::string_view>>> m_delta; // always set, allocates from RunResource()
+    InstructionSink m_sink;
+    size_t m_numberOfRecords { 0 }; // LITERAL, REMOVED and moved COPY instructions, the ones making the file changed
+    // instructions emitted by the run, added to Stats once it ends instead of per instruction
+    struct {
+        size_t m_copies { 0 };
+        size_t m_literals { 0 };
+        size_t m_literalBytes { 0 };
+        size_t m_removed { 0 };
+    } m_emitted;
 };
 
 } // filediff
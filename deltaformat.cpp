@@ -0,0 +1,307 @@
+#include <stdexcept>
+
+#include "deltaformat.h"
+#include "xxhash64.h"
+
+namespace {
+
+enum Opcode : uint8_t {
+    END = 0x00,
+    COPY = 0x01,
+    LITERAL = 0x02,
+    LITERAL_BLOCK = 0x03
+};
+
+void AppendVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void WriteVarint(std::ostream& out, uint64_t value)
+{
+    std::string buffer;
+    AppendVarint(buffer, value);
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+}
+
+uint64_t ZigZag(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t UnZigZag(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+} // namespace
+
+filediff::BinaryDeltaWriter::BinaryDeltaWriter(std::ostream& out, const Signature::Metadata& metadata, Codec* codec)
+    : m_out { out }
+    , m_codec { codec }
+{
+    // a line matched by adler32 alone may differ from the base one, patch would copy wrong content
+    if (!metadata.m_strongHashes) {
+        throw std::invalid_argument("Binary delta needs a signature with strong hashes, calculate it with --strong-hash!");
+    }
+    m_out.write(BINARY_DELTA_MAGIC.data(), BINARY_DELTA_MAGIC.size());
+    // uncompressed BLOCK and CDC mode delta stays readable by version 1 readers, LINE mode one needs the flags
+    const auto version { metadata.m_mode == Signature::ChunkingMode::LINE ? BINARY_DELTA_VERSION : m_codec ? 2 : 1 };
+    WriteVarint(m_out, version);
+    m_out.put(static_cast<char>(metadata.m_mode));
+    WriteVarint(m_out, metadata.m_chunkLenght);
+    if (metadata.m_mode == Signature::ChunkingMode::CDC) {
+        WriteVarint(m_out, metadata.m_minChunkLength);
+        WriteVarint(m_out, metadata.m_maxChunkLength);
+    }
+    if (version > 1) {
+        m_out.put(static_cast<char>(m_codec ? m_codec->Type() : CodecType::NONE));
+    }
+    if (version > 2) {
+        m_out.put(static_cast<char>(VERIFIED_COPIES_FLAG));
+    }
+    if (m_codec) {
+        m_literals.reserve(LITERAL_BLOCK_SIZE);
+    }
+}
+
+void filediff::BinaryDeltaWriter::operator()(const Delta::Instruction& instruction)
+{
+    switch (instruction.m_type) {
+    case Delta::Instruction::Type::COPY:
+        FlushLiteral();
+        if (m_copyCount > 0 && instruction.m_baseChunk == m_copyFirst + m_copyCount) {
+            m_copyCount++;
+        } else {
+            FlushCopy();
+            m_copyFirst = instruction.m_baseChunk;
+            m_copyCount = 1;
+        }
+        break;
+    case Delta::Instruction::Type::LITERAL:
+        FlushCopy();
+        if (!m_literal.empty() && m_literal.data() + m_literal.size() == instruction.m_data.data()) {
+            m_literal = { m_literal.data(), m_literal.size() + instruction.m_data.size() };
+        } else {
+            FlushLiteral();
+            m_literal = instruction.m_data;
+        }
+        break;
+    case Delta::Instruction::Type::REMOVED:
+        break; // implied by chunks which are not copied
+    case Delta::Instruction::Type::END: {
+        FlushCopy();
+        FlushLiteral();
+        FlushBlock();
+        m_out.put(static_cast<char>(Opcode::END));
+        WriteVarint(m_out, instruction.m_data.size());
+        auto checksum { xxhash64(instruction.m_data) };
+        for (auto i { 0 }; i < 8; ++i, checksum >>= 8) {
+            m_out.put(static_cast<char>(checksum & 0xFF));
+        }
+        m_out.flush();
+        break;
+    }
+    }
+}
+
+void filediff::BinaryDeltaWriter::FlushCopy()
+{
+    if (m_copyCount == 0) {
+        return;
+    }
+    m_records.push_back(static_cast<char>(Opcode::COPY));
+    AppendVarint(m_records, ZigZag(static_cast<int64_t>(m_copyFirst - m_expectedChunk)));
+    AppendVarint(m_records, m_copyCount);
+    m_expectedChunk = m_copyFirst + m_copyCount;
+    m_copyCount = 0;
+    // only records following pending literals have to wait for their block
+    if (m_literals.empty()) {
+        WriteRecords();
+    }
+}
+
+void filediff::BinaryDeltaWriter::FlushLiteral()
+{
+    if (m_literal.empty()) {
+        return;
+    }
+    if (!m_codec) {
+        m_records.push_back(static_cast<char>(Opcode::LITERAL));
+        AppendVarint(m_records, m_literal.size());
+        WriteRecords();
+        m_out.write(m_literal.data(), static_cast<std::streamsize>(m_literal.size()));
+        m_literal = {};
+        return;
+    }
+
+    // a literal not fitting into current block is split, no block grows over LITERAL_BLOCK_SIZE
+    while (!m_literal.empty()) {
+        const auto part { m_literal.substr(0, LITERAL_BLOCK_SIZE - m_literals.size()) };
+        m_records.push_back(static_cast<char>(Opcode::LITERAL));
+        AppendVarint(m_records, part.size());
+        m_literals += part;
+        m_literal.remove_prefix(part.size());
+        if (m_literals.size() == LITERAL_BLOCK_SIZE) {
+            FlushBlock();
+        }
+    }
+}
+
+void filediff::BinaryDeltaWriter::FlushBlock()
+{
+    if (!m_literals.empty()) {
+        m_compressed.clear();
+        m_codec->Compress(m_literals, m_compressed);
+        std::string header(1, static_cast<char>(Opcode::LITERAL_BLOCK));
+        AppendVarint(header, m_literals.size());
+        AppendVarint(header, m_compressed.size());
+        m_out.write(header.data(), static_cast<std::streamsize>(header.size()));
+        m_out.write(m_compressed.data(), static_cast<std::streamsize>(m_compressed.size()));
+        m_literals.clear();
+    }
+    WriteRecords();
+}
+
+void filediff::BinaryDeltaWriter::WriteRecords()
+{
+    m_out.write(m_records.data(), static_cast<std::streamsize>(m_records.size()));
+    m_records.clear();
+}
+
+filediff::BinaryDeltaReader::BinaryDeltaReader(std::string_view data)
+    : m_data { data }
+{
+    const auto magic { ReadBytes(BINARY_DELTA_MAGIC.size()) };
+    if (magic != std::string_view { BINARY_DELTA_MAGIC.data(), BINARY_DELTA_MAGIC.size() }) {
+        throw std::runtime_error("Not a binary delta!");
+    }
+    const auto version { ReadVarint() };
+    if (version == 0 || version > BINARY_DELTA_VERSION) {
+        throw std::runtime_error("Unsupported binary delta version!");
+    }
+    const auto mode { static_cast<uint8_t>(ReadBytes(1)[0]) };
+    if (mode > static_cast<uint8_t>(Signature::ChunkingMode::CDC)) {
+        throw std::runtime_error("Unsupported chunking mode in binary delta!");
+    }
+    m_header = Header { static_cast<Signature::ChunkingMode>(mode), static_cast<uint32_t>(ReadVarint()) };
+    if (m_header.m_mode == Signature::ChunkingMode::CDC) {
+        m_header.m_minChunkLength = static_cast<uint32_t>(ReadVarint());
+        m_header.m_maxChunkLength = static_cast<uint32_t>(ReadVarint());
+    }
+    if (version > 1) {
+        const auto codec { static_cast<uint8_t>(ReadBytes(1)[0]) };
+        if (codec > static_cast<uint8_t>(CodecType::LZ4)) {
+            throw std::runtime_error("Unsupported codec in binary delta!");
+        }
+        m_header.m_codec = static_cast<CodecType>(codec);
+        m_codec = MakeCodec(m_header.m_codec);
+    }
+    // LINE mode copies are verified only when the delta says so, the other modes always have strong hashes
+    m_header.m_verifiedCopies = m_header.m_mode != Signature::ChunkingMode::LINE;
+    if (version > 2) {
+        const auto flags { static_cast<uint8_t>(ReadBytes(1)[0]) };
+        if ((flags & ~VERIFIED_COPIES_FLAG) != 0) {
+            throw std::runtime_error("Unsupported flags in binary delta!");
+        }
+        m_header.m_verifiedCopies = m_header.m_verifiedCopies || (flags & VERIFIED_COPIES_FLAG) != 0;
+    }
+}
+
+const filediff::BinaryDeltaReader::Header& filediff::BinaryDeltaReader::GetHeader() const noexcept
+{
+    return m_header;
+}
+
+std::optional<filediff::BinaryDeltaReader::Record> filediff::BinaryDeltaReader::Next()
+{
+    if (m_finished) {
+        return std::nullopt;
+    }
+
+    Record record;
+    auto opcode { static_cast<uint8_t>(ReadBytes(1)[0]) };
+    for (; opcode == Opcode::LITERAL_BLOCK; opcode = static_cast<uint8_t>(ReadBytes(1)[0])) {
+        ReadLiteralBlock();
+    }
+    switch (opcode) {
+    case Opcode::COPY:
+        record.m_type = Record::Type::COPY;
+        record.m_firstChunk = m_expectedChunk + static_cast<uint64_t>(UnZigZag(ReadVarint()));
+        record.m_numberOfChunks = ReadVarint();
+        m_expectedChunk = record.m_firstChunk + record.m_numberOfChunks;
+        break;
+    case Opcode::LITERAL: {
+        record.m_type = Record::Type::LITERAL;
+        const auto size { ReadVarint() };
+        if (!m_codec) {
+            record.m_literal = ReadBytes(size);
+            break;
+        }
+        if (size > m_block.size() - m_blockPosition) {
+            throw std::runtime_error("Corrupted binary delta, literal exceeds its block!");
+        }
+        record.m_literal = std::string_view { m_block }.substr(m_blockPosition, size);
+        m_blockPosition += size;
+        break;
+    }
+    case Opcode::END: {
+        if (m_blockPosition != m_block.size()) {
+            throw std::runtime_error("Corrupted binary delta, unused literals!");
+        }
+        record.m_type = Record::Type::END;
+        record.m_fileSize = ReadVarint();
+        const auto checksum { ReadBytes(8) };
+        for (auto i { 7 }; i >= 0; --i) {
+            record.m_checksum = (record.m_checksum << 8) | static_cast<uint8_t>(checksum[i]);
+        }
+        m_finished = true;
+        break;
+    }
+    default:
+        throw std::runtime_error("Corrupted binary delta, unknown opcode!");
+    }
+    return record;
+}
+
+uint64_t filediff::BinaryDeltaReader::ReadVarint()
+{
+    uint64_t value { 0 };
+    for (auto shift { 0 }; shift < 64; shift += 7) {
+        const auto byte { static_cast<uint8_t>(ReadBytes(1)[0]) };
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Corrupted binary delta, varint too long!");
+}
+
+void filediff::BinaryDeltaReader::ReadLiteralBlock()
+{
+    // previous block has to be used up, literals never span blocks
+    if (!m_codec || m_blockPosition != m_block.size()) {
+        throw std::runtime_error("Corrupted binary delta, unexpected literal block!");
+    }
+    const auto size { ReadVarint() };
+    if (size > LITERAL_BLOCK_SIZE) {
+        throw std::runtime_error("Corrupted binary delta, literal block too big!");
+    }
+    const auto compressed { ReadBytes(ReadVarint()) };
+    m_codec->Decompress(compressed, size, m_block);
+    m_blockPosition = 0;
+}
+
+std::string_view filediff::BinaryDeltaReader::ReadBytes(size_t size)
+{
+    if (size > m_data.size()) {
+        throw std::runtime_error("Binary delta is truncated!");
+    }
+    const auto bytes { m_data.substr(0, size) };
+    m_data.remove_prefix(size);
+    return bytes;
+}
@@ -0,0 +1,118 @@
+#ifndef DELTAFORMAT_H
+#define DELTAFORMAT_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "codec.h"
+#include "delta.h"
+#include "signature.h"
+
+namespace filediff {
+
+// Binary delta layout (all integers are LEB128 varints unless stated otherwise):
+//   header:  "FDDL" magic, version, chunking mode (1 byte), chunk length, in CDC mode also min and max chunk length,
+//            since version 2 also codec of literals (1 byte, see codec.h), since version 3 also flags (1 byte, bit
+//            0 set when every copied chunk matched by strong hash too, which BLOCK and CDC mode imply)
+//   COPY:    0x01, zigzag encoded distance of first chunk from the end of previous copy, number of chunks
+//   LITERAL: 0x02, length, raw bytes (no bytes with a codec, they are taken from the current literal block)
+//   LITERAL BLOCK: 0x03, original size, compressed size, compressed bytes; literals of the records following it up
+//            to the next block, concatenated and compressed at once (only with a codec)
+//   END:     0x00, size of updated file, XXH64 of updated file (8 bytes, little-endian)
+// Chunks are counted in units of the signature (lines or blocks), adjacent copied chunks are coalesced into a single
+// COPY and adjacent literals into a single LITERAL. In LINE mode every copied line is followed by '\n', the final
+// size from END tells whether the updated file ends with it. BLOCK and CDC mode deltas without codec are written as
+// version 1, with codec as version 2; LINE mode ones always as version 3, copies of earlier ones may rest on adler32
+// alone and patch refuses them.
+constexpr std::array<char, 4> BINARY_DELTA_MAGIC { 'F', 'D', 'D', 'L' };
+constexpr uint32_t BINARY_DELTA_VERSION { 3 };
+constexpr uint8_t VERIFIED_COPIES_FLAG { 0x01 };
+
+// literals are compressed in blocks of up to this size, bigger blocks are refused as corrupted on reading
+constexpr size_t LITERAL_BLOCK_SIZE { 1 << 20 };
+
+// instruction sink writing the binary format, pass it to Delta::CalculateInstructions() with std::ref; the signature
+// shall have strong hashes (LINE mode one calculated with them) so that every COPY is verified, else ctor throws;
+// with a codec literals are collected into blocks of LITERAL_BLOCK_SIZE and records using them are held back until
+// their block is written, so short literals compress together and memory use stays bounded
+class BinaryDeltaWriter
+{
+public:
+    BinaryDeltaWriter(std::ostream& out, const Signature::Metadata& metadata, Codec* codec = nullptr);
+
+    void operator()(const Delta::Instruction& instruction);
+
+private:
+    void FlushCopy();
+    void FlushLiteral();
+    void FlushBlock();
+    void WriteRecords();
+
+    std::ostream& m_out;
+    Codec* m_codec;
+    std::string m_records; // encoded records not written yet
+    std::string m_literals; // literals of current block
+    std::string m_compressed;
+    uint64_t m_copyFirst { 0 };
+    uint64_t m_copyCount { 0 };
+    uint64_t m_expectedChunk { 0 }; // chunk following the last written copy
+    std::string_view m_literal; // pending literal, contiguous part of updated file
+};
+
+class BinaryDeltaReader
+{
+public:
+    struct Header {
+        Signature::ChunkingMode m_mode;
+        uint32_t m_chunkLength;
+        uint32_t m_minChunkLength { 0 }; // CDC mode only
+        uint32_t m_maxChunkLength { 0 }; // CDC mode only
+        CodecType m_codec { CodecType::NONE };
+        bool m_verifiedCopies { false }; // copies can be trusted, see VERIFIED_COPIES_FLAG
+    };
+
+    struct Record {
+        enum class Type {
+            COPY,
+            LITERAL,
+            END
+        };
+
+        Type m_type;
+        uint64_t m_firstChunk { 0 }; // COPY
+        uint64_t m_numberOfChunks { 0 }; // COPY
+        std::string_view m_literal; // LITERAL, view into the data given to reader or, with a codec, into decompressed block
+        uint64_t m_fileSize { 0 }; // END
+        uint64_t m_checksum { 0 }; // END
+    };
+
+    // data has to outlive the reader and all records returned by it; literals of compressed delta are valid only until
+    // the next call of Next()
+    explicit BinaryDeltaReader(std::string_view data);
+
+    const Header& GetHeader() const noexcept;
+
+    // next record, std::nullopt once END has been returned
+    std::optional<Record> Next();
+
+private:
+    uint64_t ReadVarint();
+    std::string_view ReadBytes(size_t size);
+    void ReadLiteralBlock();
+
+    std::string_view m_data;
+    Header m_header;
+    std::unique_ptr<Codec> m_codec;
+    std::string m_block; // decompressed literals
+    size_t m_blockPosition { 0 }; // of the next literal in m_block
+    uint64_t m_expectedChunk { 0 };
+    bool m_finished { false };
+};
+
+} // filediff
+#endif // DELTAFORMAT_H
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <bit>
+
+#include "hashindex.h"
+
+// adler32 values of similar chunks differ only in a few bits, so they are spread over the table with murmur3
+// finalizer before taking the low bits, otherwise linear probing ends up with long clusters
+static uint32_t Mix(uint32_t hash) noexcept
+{
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BU;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35U;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+void filediff::HashIndex::Prepare(size_t numberOfItems)
+{
+    // keep load factor at or below 0.5 so probe sequences stay short
+    const auto capacity { std::bit_ceil(std::max<size_t>(numberOfItems * 2, 16)) };
+    m_slots.assign(capacity, Slot { 0, 0, 0 });
+    m_positions.assign(numberOfItems, NPOS);
+    m_mask = static_cast<uint32_t>(capacity - 1);
+}
+
+void filediff::HashIndex::Count(uint32_t hash)
+{
+    LookupOrInsert(hash).count++;
+}
+
+void filediff::HashIndex::Finalize()
+{
+    auto offset { 0U };
+    for (auto& slot : m_slots) {
+        offset += slot.count;
+        slot.offset = offset;
+    }
+}
+
+void filediff::HashIndex::Place(uint32_t hash, uint32_t position)
+{
+    auto& slot { LookupOrInsert(hash) };
+    m_positions[--slot.offset] = position;
+}
+
+const filediff::HashIndex::Slot* filediff::HashIndex::Lookup(uint32_t hash) const noexcept
+{
+    if (m_slots.empty()) {
+        return nullptr;
+    }
+
+    for (auto i { Mix(hash) & m_mask };; i = (i + 1) & m_mask) {
+        const auto& slot { m_slots[i] };
+        if (slot.count == 0) {
+            return nullptr;
+        }
+        if (slot.hash == hash) {
+            return &slot;
+        }
+    }
+}
+
+filediff::HashIndex::Slot& filediff::HashIndex::LookupOrInsert(uint32_t hash) noexcept
+{
+    for (auto i { Mix(hash) & m_mask };; i = (i + 1) & m_mask) {
+        auto& slot { m_slots[i] };
+        if (slot.count == 0 || slot.hash == hash) {
+            slot.hash = hash;
+            return slot;
+        }
+    }
+}
+
+std::span<const uint32_t> filediff::HashIndex::Find(uint32_t hash) const noexcept
+{
+    const auto* slot { Lookup(hash) };
+    if (slot == nullptr) {
+        return {};
+    }
+    return { m_positions.data() + slot->offset, slot->count };
+}
+
+uint32_t filediff::HashIndex::FindFrom(uint32_t hash, uint32_t from) const noexcept
+{
+    const auto positions { Find(hash) };
+    const auto it { std::lower_bound(std::cbegin(positions), std::cend(positions), from) };
+    return it == std::cend(positions) ? NPOS : *it;
+}
+
+bool filediff::HashIndex::Contains(uint32_t hash) const noexcept
+{
+    return Lookup(hash) != nullptr;
+}
@@ -0,0 +1,66 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <vector>
+
+namespace filediff {
+
+// Open-addressing index mapping a 32-bit chunk hash to all positions at which it occurs in the indexed sequence.
+// Positions of one hash are stored contiguously and in ascending order, so lookups never walk the whole sequence.
+class HashIndex
+{
+public:
+    static constexpr uint32_t NPOS { std::numeric_limits<uint32_t>::max() };
+
+    HashIndex() = default;
+
+    template <typename Container, typename Projection = std::identity>
+    explicit HashIndex(const Container& items, Projection projection = {})
+    {
+        Prepare(std::size(items));
+        for (const auto& item : items) {
+            Count(std::invoke(projection, item));
+        }
+        Finalize();
+        // positions are placed back to front so that every hash ends up with its positions sorted ascending
+        auto position { static_cast<uint32_t>(std::size(items)) };
+        for (auto it { std::rbegin(items) }; it != std::rend(items); ++it) {
+            Place(std::invoke(projection, *it), --position);
+        }
+    }
+
+    // all positions of given hash in ascending order (empty if hash is not indexed)
+    std::span<const uint32_t> Find(uint32_t hash) const noexcept;
+
+    // first position of given hash that is not smaller than 'from', NPOS if there is none
+    uint32_t FindFrom(uint32_t hash, uint32_t from) const noexcept;
+
+    bool Contains(uint32_t hash) const noexcept;
+
+private:
+    struct Slot {
+        uint32_t hash;
+        uint32_t offset; // into m_positions, points past the end of the run while index is being built
+        uint32_t count; // 0 means slot is empty
+    };
+
+    void Prepare(size_t numberOfItems);
+    void Count(uint32_t hash);
+    void Finalize();
+    void Place(uint32_t hash, uint32_t position);
+
+    const Slot* Lookup(uint32_t hash) const noexcept;
+    Slot& LookupOrInsert(uint32_t hash) noexcept;
+
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_positions;
+    uint32_t m_mask { 0 };
+};
+
+} // filediff
+#endif // HASHINDEX_H
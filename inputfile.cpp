@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include "inputfile.h"
+#include "readpipeline.h"
+#include "stats.h"
+#include "threadpool.h"
+
+namespace {
+
+// closes file descriptor on every path out of the constructor
+struct FileDescriptor {
+    ~FileDescriptor()
+    {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    int fd;
+};
+
+constexpr size_t READ_CHUNK_SIZE { 1 << 20 };
+// whether every page of mapped data is in page cache
+bool IsResident(std::string_view mapped)
+{
+    const auto pageSize { static_cast<size_t>(::sysconf(_SC_PAGESIZE)) };
+    std::vector<unsigned char> pages((mapped.size() + pageSize - 1) / pageSize);
+    if (::mincore(const_cast<char*>(mapped.data()), mapped.size(), pages.data()) != 0) {
+        return false;
+    }
+    return std::ranges::all_of(pages, [](unsigned char page) { return page & 1; });
+}
+
+// partitions smaller than that are not worth a task of their own
+constexpr size_t MIN_PARTITION_SIZE { 1 << 20 };
+// more partitions than workers lets faster workers steal the remaining ones
+constexpr size_t PARTITIONS_PER_WORKER { 4 };
+
+} // namespace
+
+filediff::InputFile::InputFile(std::string_view path)
+{
+    const FileDescriptor file { ::open(std::string { path }.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (file.fd < 0) {
+        throw std::runtime_error(fmt::format("File {} not found!", path));
+    }
+
+    struct stat status { };
+    if (::fstat(file.fd, &status) == 0 && S_ISREG(status.st_mode)) {
+        if (status.st_size == 0 || Map(file.fd, static_cast<size_t>(status.st_size))) {
+            FILEDIFF_STATS_ADD(BYTES_READ, m_data.size());
+            return;
+        }
+    }
+
+    // not mappable (pipe, character device or mmap failure) - fall back to plain buffered reads
+    ReadStream(file.fd, path);
+}
+
+filediff::InputFile::InputFile(std::string_view path, const std::function<void(std::string_view)>& onRead)
+{
+    const FileDescriptor file { ::open(std::string { path }.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (file.fd < 0) {
+        throw std::runtime_error(fmt::format("File {} not found!", path));
+    }
+
+    struct stat status { };
+    if (::fstat(file.fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+        ReadStream(file.fd, path);
+        onRead(m_data);
+        return;
+    }
+
+    const auto size { static_cast<size_t>(status.st_size) };
+    if (size == 0) {
+        return;
+    }
+    if (!Map(file.fd, size)) {
+        ReadStream(file.fd, path);
+        onRead(m_data);
+        return;
+    }
+    FILEDIFF_STATS_ADD(BYTES_READ, m_data.size());
+    // there is nothing to overlap for a file which is already in page cache, it is used in place
+    if (IsResident(m_data)) {
+        onRead(m_data);
+        return;
+    }
+    // otherwise the mapping is handed out window by window with readahead requested a few windows ahead, so the
+    // following ones are being read while the current one is processed; chunks stay views into the mapping
+    constexpr auto window { ReadPipeline::DEFAULT_BUFFER_SIZE };
+    constexpr auto ahead { window * ReadPipeline::DEFAULT_DEPTH };
+    size_t advised { 0 };
+    for (size_t end { std::min(window, size) };; end = std::min(end + window, size)) {
+        for (; advised < std::min(end + ahead, size); advised += window) {
+            ::madvise(static_cast<char*>(m_mapping) + advised, std::min(window, size - advised), MADV_WILLNEED);
+        }
+        onRead(m_data.substr(0, end));
+        if (end == size) {
+            break;
+        }
+    }
+}
+
+bool filediff::InputFile::Map(int fd, size_t size)
+{
+    auto* mapping { ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) };
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    ::madvise(mapping, size, MADV_SEQUENTIAL);
+    m_mapping = mapping;
+    m_mappingSize = size;
+    m_data = { static_cast<const char*>(m_mapping), m_mappingSize };
+    return true;
+}
+
+void filediff::InputFile::ReadStream(int fd, std::string_view path)
+{
+    while (true) {
+        const auto used { m_buffer.size() };
+        m_buffer.resize(used + READ_CHUNK_SIZE);
+        const auto result { ::read(fd, m_buffer.data() + used, READ_CHUNK_SIZE) };
+        if (result < 0 && errno == EINTR) {
+            m_buffer.resize(used);
+            continue;
+        }
+        if (result < 0) {
+            throw std::runtime_error(fmt::format("Reading file {} failed!", path));
+        }
+        m_buffer.resize(used + static_cast<size_t>(result));
+        if (result == 0) {
+            break;
+        }
+    }
+    m_data = m_buffer;
+    FILEDIFF_STATS_ADD(BYTES_READ, m_data.size());
+}
+
+filediff::InputFile::~InputFile()
+{
+    Unmap();
+}
+
+filediff::InputFile::InputFile(InputFile&& other) noexcept
+    : m_mapping { std::exchange(other.m_mapping, nullptr) }
+    , m_mappingSize { std::exchange(other.m_mappingSize, 0) }
+    , m_buffer { std::move(other.m_buffer) }
+    , m_data { m_mapping ? std::exchange(other.m_data, {}) : std::string_view { m_buffer } }
+{
+    other.m_data = {};
+}
+
+filediff::InputFile& filediff::InputFile::operator=(InputFile&& other) noexcept
+{
+    if (this != &other) {
+        Unmap();
+        m_mapping = std::exchange(other.m_mapping, nullptr);
+        m_mappingSize = std::exchange(other.m_mappingSize, 0);
+        m_buffer = std::move(other.m_buffer);
+        m_data = m_mapping ? other.m_data : std::string_view { m_buffer };
+        other.m_data = {};
+    }
+    return *this;
+}
+
+void filediff::InputFile::Unmap() noexcept
+{
+    if (m_mapping != nullptr) {
+        ::munmap(m_mapping, m_mappingSize);
+        m_mapping = nullptr;
+        m_mappingSize = 0;
+    }
+}
+
+std::string_view filediff::InputFile::Data() const noexcept
+{
+    return m_data;
+}
+
+bool filediff::InputFile::IsMapped() const noexcept
+{
+    return m_mapping != nullptr;
+}
+
+filediff::ChunkReader::ChunkReader(std::string_view data) noexcept
+    : m_data { data }
+{
+}
+
+std::optional<std::string_view> filediff::ChunkReader::NextLine() noexcept
+{
+    if (m_position >= m_data.size()) {
+        return std::nullopt;
+    }
+
+    auto end { m_data.find('\n', m_position) };
+    if (end == std::string_view::npos) {
+        end = m_data.size(); // last line without trailing newline
+    }
+    const auto line { m_data.substr(m_position, end - m_position) };
+    m_position = end + 1;
+    return line;
+}
+
+std::optional<std::string_view> filediff::ChunkReader::NextBlock(size_t blockSize) noexcept
+{
+    if (m_position >= m_data.size()) {
+        return std::nullopt;
+    }
+
+    const auto block { m_data.substr(m_position, blockSize) };
+    m_position += block.size();
+    return block;
+}
+
+std::optional<std::string_view> filediff::ChunkReader::NextChunk(const CdcParameters& parameters) noexcept
+{
+    if (m_position >= m_data.size()) {
+        return std::nullopt;
+    }
+
+    return NextBlock(CdcChunkLength(m_data.substr(m_position), parameters));
+}
+
+size_t filediff::ChunkReader::Position() const noexcept
+{
+    return std::min(m_position, m_data.size());
+}
+
+size_t filediff::NumberOfPartitions(size_t dataSize, const ThreadPool* pool) noexcept
+{
+    if (pool == nullptr || pool->Size() < 2) {
+        return 1;
+    }
+    return std::clamp<size_t>(dataSize / MIN_PARTITION_SIZE, 1, pool->Size() * PARTITIONS_PER_WORKER);
+}
+
+std::vector<std::string_view> filediff::SplitIntoPartitions(std::string_view data, size_t numberOfPartitions, size_t blockSize)
+{
+    std::vector<std::string_view> partitions;
+    size_t begin { 0 };
+    for (size_t i { 1 }; i <= numberOfPartitions && begin < data.size(); ++i) {
+        auto end { data.size() * i / numberOfPartitions };
+        if (i == numberOfPartitions) {
+            end = data.size();
+        } else if (blockSize != 0) {
+            end -= end % blockSize;
+        } else {
+            const auto newline { data.find('\n', std::max(end, begin + 1) - 1) };
+            end = newline == std::string_view::npos ? data.size() : newline + 1;
+        }
+
+        if (end > begin) {
+            partitions.push_back(data.substr(begin, end - begin));
+            begin = end;
+        }
+    }
+    return partitions;
+}
@@ -0,0 +1,84 @@
+#ifndef INPUTFILE_H
+#define INPUTFILE_H
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cdc.h"
+
+namespace filediff {
+
+class ThreadPool;
+
+// Read-only content of a whole input file. Regular files are memory mapped (with sequential access hint), anything
+// which cannot be mapped, like pipes, is read with read(2) into an owned buffer. Either way Data() stays valid for
+// the lifetime of the object, so chunks handed out from it need no copies.
+class InputFile
+{
+public:
+    explicit InputFile(std::string_view path);
+
+    // regular file which is not in page cache yet is mapped with readahead kept a few windows ahead and onRead gets
+    // the part of Data() read so far after every window, so it can be processed while the rest is still being read;
+    // for cached files and ones which cannot be mapped onRead is called once with all data
+    InputFile(std::string_view path, const std::function<void(std::string_view)>& onRead);
+
+    ~InputFile();
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+    InputFile(InputFile&& other) noexcept;
+    InputFile& operator=(InputFile&& other) noexcept;
+
+    std::string_view Data() const noexcept;
+
+    bool IsMapped() const noexcept;
+
+private:
+    bool Map(int fd, size_t size);
+    void ReadStream(int fd, std::string_view path);
+    void Unmap() noexcept;
+
+    void* m_mapping { nullptr };
+    size_t m_mappingSize { 0 };
+    std::string m_buffer;
+    std::string_view m_data;
+};
+
+// Cuts given data into consecutive lines or blocks, every chunk is a view into the original data
+class ChunkReader
+{
+public:
+    explicit ChunkReader(std::string_view data) noexcept;
+
+    // next '\n' terminated line without the terminator, last line does not need to be terminated
+    std::optional<std::string_view> NextLine() noexcept;
+
+    // next block of given size, last block may be shorter
+    std::optional<std::string_view> NextBlock(size_t blockSize) noexcept;
+
+    // next content-defined chunk
+    std::optional<std::string_view> NextChunk(const CdcParameters& parameters) noexcept;
+
+    // offset of the next chunk from the beginning of data
+    size_t Position() const noexcept;
+
+private:
+    std::string_view m_data;
+    size_t m_position { 0 };
+};
+
+// number of partitions worth splitting data of given size into so it can be processed on the pool, 1 means that data
+// is too small (or there is no pool) and it should be processed in one go
+size_t NumberOfPartitions(size_t dataSize, const ThreadPool* pool) noexcept;
+
+// splits data into partitions starting at line boundaries (or at block boundaries if blockSize is given), so that
+// processing them independently and concatenating the results gives the same chunks as processing data at once
+std::vector<std::string_view> SplitIntoPartitions(std::string_view data, size_t numberOfPartitions, size_t blockSize = 0);
+
+} // filediff
+#endif // INPUTFILE_H
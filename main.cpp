@@ -1,18 +1,33 @@
+#include <algorithm>
 #include <boost/program_options.hpp>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <optional>
 
+#include "batch.h"
+#include "codec.h"
 #include "delta.h"
+#include "deltaformat.h"
+#include "patch.h"
 #include "signature.h"
+#include "signaturecache.h"
+#include "stats.h"
+#include "threadpool.h"
 
 namespace po = boost::program_options;
 
 int main(int argc, char* argv[])
 {
+    int result { 0 };
     try {
-        std::string inDataFile, outSignatureFile, sigfile, newdata;
+        std::string inDataFile, outSignatureFile, sigfile, newdata, basis, deltafile, format { "text" }, stats, align { "greedy" }, manifest, update, cacheDir, compress { "none" };
+        uint32_t blockSize { 0 }, cdcAverage { 0 }, cdcMin { 0 }, cdcMax { 0 }, treeFanout { 0 };
+        unsigned threads { 1 };
+        int compressLevel { 0 };
+        uint64_t batchMemory { 1024 }, unchangedBytes { 0 }, cacheSize { 1024 };
         po::options_description desc("Allowed options");
-        desc.add_options()("help", "produce help message")("signature", "produce signature for given file")("infile", po::value(&inDataFile), "input file for which signature shall be calculated")("outfile", po::value(&outSignatureFile), "output file to which signature shall be stored")("delta", "calculates delta based on given sigfile and newdata files")("sigfile", po::value(&sigfile), "signature file calculated for base data file")("newdata", po::value(&newdata), "data file to be compared");
+        desc.add_options()("help", "produce help message")("signature", "produce signature for given file")("infile", po::value(&inDataFile), "input file for which signature shall be calculated")("outfile", po::value(&outSignatureFile), "output file to which signature shall be stored")("block-size", po::value(&blockSize), "split input file into blocks of given size in bytes instead of lines (used with --signature)")("cdc", po::value(&cdcAverage), "split input file into content-defined chunks of given average size in bytes (used with --signature)")("cdc-min", po::value(&cdcMin), "minimal content-defined chunk size (default average / 4, at least 64)")("cdc-max", po::value(&cdcMax), "maximal content-defined chunk size (default average * 8)")("strong-hash", "store also XXH64 of every line in signature, delta then verifies every adler32 match with it (implied by --block-size)")("tree-fanout", po::value(&treeFanout), "add hash tree over runs of given number of blocks to block signature, delta then confirms unchanged runs with one comparison (used with --block-size)")("update", po::value(&update), "previous signature of infile, only chunks after the unchanged bytes are hashed again (used with --signature)")("unchanged-bytes", po::value(&unchangedBytes), "length of infile beginning unchanged since previous signature (default its whole old size, i.e. file was only appended to)")("cache-dir", po::value(&cacheDir), "directory caching signatures of unchanged files (keyed by device, inode, size, mtime and chunking parameters, used with --signature)")("cache-size", po::value(&cacheSize), "limit of signature cache size in MiB, least recently used entries are removed above it (default 1024)")("threads", po::value(&threads), "number of threads used to calculate signature or delta (default 1)")("delta", "calculates delta based on given sigfile and newdata files")("sigfile", po::value(&sigfile), "signature file calculated for base data file")("newdata", po::value(&newdata), "data file to be compared")("format", po::value(&format), "delta output format: text (default) or binary (line signature shall be made with --strong-hash)")("compress", po::value(&compress), "codec compressing literals of binary delta: none (default), zlib, zstd or lz4 (the ones built in)")("compress-level", po::value(&compressLevel), "compression level, default one of the codec if not given")("align", po::value(&align), "line alignment used by delta: greedy (default) or patience (smaller delta, moved lines are reused)")("patch", "rebuilds updated file from basis file and binary delta, result is written to outfile")("basis", po::value(&basis), "base data file the delta was calculated against")("deltafile", po::value(&deltafile), "binary delta file")("batch", po::value(&manifest), "calculates deltas for all jobs listed in manifest file (sigfile newdata outfile per line) on --threads workers, --format and --align apply to every job")("batch-memory", po::value(&batchMemory), "limit in MiB for sizes of signature and data files of batch jobs processed at once (default 1024)")("stats", po::value(&stats)->implicit_value("text"), "print phase timings and counters to stderr when done, --stats=json for JSON");
 
         po::variables_map vm;
         po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -23,18 +38,91 @@ int main(int argc, char* argv[])
             return 0;
         }
 
-        if (vm.count("signature") && vm.count("delta")) {
-            std::cout << "signature and delta should not be called at once!\n";
+        if (vm.count("signature") + vm.count("delta") + vm.count("patch") + vm.count("batch") > 1) {
+            std::cout << "only one of signature, delta, patch and batch should be called at once!\n";
             return -1;
         }
 
+        if (vm.count("stats") && stats != "text" && stats != "json") {
+            std::cout << "--stats shall be either text or json\n";
+            return -7;
+        }
+
+        if (format != "text" && format != "binary") {
+            std::cout << "--format shall be either text or binary\n";
+            return -5;
+        }
+
+        if (align != "greedy" && align != "patience") {
+            std::cout << "--align shall be either greedy or patience\n";
+            return -9;
+        }
+        const auto engine { align == "patience" ? filediff::Delta::MatchingEngine::PATIENCE : filediff::Delta::MatchingEngine::INDEXED };
+
+        const auto codecType { filediff::CodecFromName(compress) };
+        if (!codecType || !filediff::IsCodecAvailable(*codecType) || (*codecType != filediff::CodecType::NONE && format != "binary")) {
+            std::cout << "--compress shall be a codec built in (none, zlib, zstd or lz4) and used with --format binary\n";
+            return -11;
+        }
+
+        std::optional<filediff::ThreadPool> pool;
+        if (threads > 1 || vm.count("batch")) {
+            pool.emplace(threads);
+        }
+
         if (vm.count("signature")) {
             if (inDataFile == "") {
                 std::cout << "--infile is required with --signature\n";
                 return -2;
             }
 
-            filediff::Signature signature(inDataFile, filediff::Signature::InputFileType::BASIS);
+            if (vm.count("block-size") && vm.count("cdc")) {
+                std::cout << "--block-size and --cdc should not be used at once!\n";
+                return -8;
+            }
+
+            if (vm.count("tree-fanout") && !vm.count("block-size")) {
+                std::cout << "--tree-fanout is used with --block-size only!\n";
+                return -12;
+            }
+
+            if (vm.count("update") && (vm.count("block-size") || vm.count("cdc") || vm.count("strong-hash") || vm.count("tree-fanout"))) {
+                std::cout << "--update takes chunking parameters from previous signature!\n";
+                return -10;
+            }
+
+            const auto mode { vm.count("block-size") ? filediff::Signature::ChunkingMode::BLOCK : filediff::Signature::ChunkingMode::LINE };
+            const auto defaultCdc { filediff::DefaultCdcParameters(cdcAverage) };
+            const filediff::CdcParameters cdc { vm.count("cdc-min") ? cdcMin : defaultCdc.m_minLength, cdcAverage,
+                vm.count("cdc-max") ? cdcMax : defaultCdc.m_maxLength };
+            const auto signature { [&] {
+                if (vm.count("update")) {
+                    // previous signature is released before output, which may be the same file, is written
+                    const filediff::Signature previous { update, filediff::Signature::InputFileType::SIGNATURE };
+                    return filediff::Signature(inDataFile, previous, vm.count("unchanged-bytes") ? unchangedBytes : previous.GetMetadata().m_fileSize,
+                        pool ? &*pool : nullptr);
+                }
+                auto calculate = [&] {
+                    if (vm.count("cdc")) {
+                        return filediff::Signature(inDataFile, cdc, pool ? &*pool : nullptr);
+                    }
+                    filediff::Signature signature { inDataFile, filediff::Signature::InputFileType::BASIS, mode, blockSize,
+                        pool ? &*pool : nullptr, vm.count("strong-hash") > 0 };
+                    if (vm.count("tree-fanout")) {
+                        signature.AddTree(treeFanout);
+                    }
+                    return signature;
+                };
+                if (vm.count("cache-dir")) {
+                    filediff::SignatureCache cache { cacheDir, cacheSize << 20 };
+                    const filediff::SignatureCache::Parameters parameters { vm.count("cdc") ? filediff::Signature::ChunkingMode::CDC : mode,
+                        vm.count("cdc") ? cdc.m_averageLength : (mode == filediff::Signature::ChunkingMode::BLOCK ? blockSize : 1),
+                        vm.count("cdc") ? cdc.m_minLength : 0, vm.count("cdc") ? cdc.m_maxLength : 0, vm.count("strong-hash") > 0, treeFanout };
+                    return cache.GetOrCalculate(inDataFile, parameters, calculate);
+                }
+                return calculate();
+            }() };
+            FILEDIFF_STATS_PHASE("signature writing");
             if (outSignatureFile != "") {
                 std::ofstream outStream { outSignatureFile, std::ios::binary };
                 signature.Serialize(outStream);
@@ -52,12 +140,36 @@ int main(int argc, char* argv[])
                 return -4;
             }
 
+
+            // records are written out as soon as they are known, nothing is accumulated in memory
             filediff::Delta delta { sigfile, newdata };
-            delta.Calculate();
-            if (delta.IsChanged()) {
-                std::ostream ostream { std::cout.rdbuf() };
-                delta.SerializeDelta(ostream);
+            std::ostream ostream { std::cout.rdbuf() };
+            if (format == "binary") {
+                const auto codec { filediff::MakeCodec(*codecType, compressLevel) };
+                filediff::BinaryDeltaWriter writer { ostream, delta.GetSignatureMetadata(), codec.get() };
+                delta.CalculateInstructions(std::ref(writer), engine, pool ? &*pool : nullptr);
+            } else {
+                delta.Calculate(filediff::Delta::StreamSink(ostream), engine, pool ? &*pool : nullptr);
             }
+        } else if (vm.count("batch")) {
+            // jobs share one pool, each of them runs serially on a single worker
+            const filediff::Batch batch { manifest };
+            const filediff::Batch::Options options { format == "binary", engine, batchMemory << 20, *codecType, compressLevel };
+            if (batch.Run(*pool, options, std::cout) > 0) {
+                result = 2;
+            }
+        } else if (vm.count("patch")) {
+            if (basis == "" || deltafile == "" || outSignatureFile == "") {
+                std::cout << "--basis, --deltafile and --outfile are required with --patch\n";
+                return -6;
+            }
+
+            filediff::Patch patch { basis, deltafile };
+            patch.Apply(outSignatureFile);
+        }
+
+        if (vm.count("stats")) {
+            filediff::Stats::Instance().Print(std::cerr, stats == "json" ? filediff::Stats::Format::JSON : filediff::Stats::Format::TEXT);
         }
     } catch (std::exception& e) {
         std::cerr << "error: " << e.what() << "\n";
@@ -65,5 +177,5 @@ int main(int argc, char* argv[])
     } catch (...) {
         std::cerr << "Exception of unknown type!\n";
     }
-    return 0;
+    return result;
 }
@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include "deltaformat.h"
+#include "patch.h"
+#include "stats.h"
+#include "xxhash64.h"
+
+namespace {
+
+constexpr size_t WRITE_BUFFER_SIZE { 1 << 20 };
+
+// closes file descriptor on every path out of the scope
+struct FileDescriptor {
+    explicit FileDescriptor(int descriptor)
+        : fd { descriptor }
+    {
+    }
+
+    ~FileDescriptor()
+    {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int fd;
+};
+
+// Output written through a buffer for literals, copies go straight from basis file descriptor to the output one
+class Output
+{
+public:
+    Output(int fd, std::string_view basisData)
+        : m_fd { fd }
+        , m_basisData { basisData }
+    {
+        m_buffer.reserve(WRITE_BUFFER_SIZE);
+    }
+
+    void Write(std::string_view data)
+    {
+        if (m_buffer.size() + data.size() > WRITE_BUFFER_SIZE) {
+            Flush();
+        }
+        if (data.size() >= WRITE_BUFFER_SIZE) {
+            WriteAll(data);
+        } else {
+            m_buffer.append(data);
+        }
+        m_written += data.size();
+    }
+
+    void Copy(int basisFd, uint64_t offset, uint64_t length)
+    {
+        Flush();
+        m_written += length;
+        auto position { static_cast<off_t>(offset) };
+        while (length > 0 && m_useCopyFileRange) {
+            const auto copied { ::copy_file_range(basisFd, &position, m_fd, nullptr, length, 0) };
+            if (copied > 0) {
+                length -= static_cast<uint64_t>(copied);
+            } else if (copied < 0 && errno == EINTR) {
+                continue;
+            } else {
+                m_useCopyFileRange = false; // not supported between these files (e.g. across filesystems)
+            }
+        }
+        while (length > 0 && m_useSendfile) {
+            const auto copied { ::sendfile(m_fd, basisFd, &position, length) };
+            if (copied > 0) {
+                length -= static_cast<uint64_t>(copied);
+            } else if (copied < 0 && errno == EINTR) {
+                continue;
+            } else {
+                m_useSendfile = false;
+            }
+        }
+        if (length > 0) {
+            WriteAll(m_basisData.substr(static_cast<size_t>(position), length));
+        }
+    }
+
+    void Flush()
+    {
+        WriteAll(m_buffer);
+        m_buffer.clear();
+    }
+
+    uint64_t Written() const noexcept
+    {
+        return m_written;
+    }
+
+private:
+    void WriteAll(std::string_view data)
+    {
+        while (!data.empty()) {
+            const auto written { ::write(m_fd, data.data(), data.size()) };
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                throw std::runtime_error("Writing patched file failed!");
+            }
+            data.remove_prefix(static_cast<size_t>(written));
+        }
+    }
+
+    int m_fd;
+    std::string_view m_basisData;
+    std::string m_buffer;
+    uint64_t m_written { 0 };
+    bool m_useCopyFileRange { true };
+    bool m_useSendfile { true };
+};
+
+} // namespace
+
+filediff::Patch::Patch(std::string_view basisFileName, std::string_view deltaFileName)
+    : m_basisFileName { basisFileName }
+    , m_basis { basisFileName }
+    , m_delta { deltaFileName }
+    , m_header { BinaryDeltaReader { m_delta.Data() }.GetHeader() }
+{
+    if (m_header.m_mode == Signature::ChunkingMode::CDC) {
+        ValidateCdcParameters({ m_header.m_minChunkLength, m_header.m_chunkLength, m_header.m_maxChunkLength });
+    }
+    // a line copied on adler32 match alone may differ from the one in updated file, which only the final checksum
+    // would tell after the whole output is written
+    if (!m_header.m_verifiedCopies) {
+        throw std::runtime_error(fmt::format("Delta {} copies lines matched by adler32 only and cannot be trusted, calculate it again "
+                                             "against a signature made with --strong-hash!",
+            deltaFileName));
+    }
+}
+
+std::pair<uint64_t, uint64_t> filediff::Patch::ChunkRange(uint64_t firstChunk, uint64_t numberOfChunks) const
+{
+    const auto basisSize { m_basis.Data().size() };
+    uint64_t begin, end;
+    if (m_header.m_mode == Signature::ChunkingMode::BLOCK) {
+        begin = firstChunk * m_header.m_chunkLength;
+        end = std::min<uint64_t>((firstChunk + numberOfChunks) * m_header.m_chunkLength, basisSize);
+    } else {
+        if (firstChunk + numberOfChunks >= m_chunkOffsets.size()) {
+            throw std::runtime_error(fmt::format("Delta does not match basis file {}!", m_basisFileName));
+        }
+        begin = m_chunkOffsets[firstChunk];
+        end = m_chunkOffsets[firstChunk + numberOfChunks];
+    }
+    if (numberOfChunks == 0 || begin >= end || end > basisSize) {
+        throw std::runtime_error(fmt::format("Delta does not match basis file {}!", m_basisFileName));
+    }
+    return { begin, end };
+}
+
+void filediff::Patch::Apply(std::string_view outFileName)
+{
+    FILEDIFF_STATS_PHASE("patch");
+    BinaryDeltaReader reader { m_delta.Data() };
+    const auto lineMode { m_header.m_mode == Signature::ChunkingMode::LINE };
+    const auto basisData { m_basis.Data() };
+    if (m_header.m_mode != Signature::ChunkingMode::BLOCK && m_chunkOffsets.empty()) {
+        ChunkReader chunks { basisData };
+        const CdcParameters parameters { m_header.m_minChunkLength, m_header.m_chunkLength, m_header.m_maxChunkLength };
+        m_chunkOffsets.push_back(0);
+        while (lineMode ? chunks.NextLine() : chunks.NextChunk(parameters)) {
+            m_chunkOffsets.push_back(chunks.Position());
+        }
+    }
+
+    const FileDescriptor basis { ::open(std::string { m_basisFileName }.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (basis.fd < 0) {
+        throw std::runtime_error(fmt::format("File {} not found!", m_basisFileName));
+    }
+
+    // result is written next to the target and renamed over it only once it is verified
+    const std::string outName { outFileName };
+    const auto tmpName { outName + ".tmp" };
+    auto fail = [&tmpName](const std::string& message) {
+        std::remove(tmpName.c_str());
+        throw std::runtime_error(message);
+    };
+
+    std::optional<BinaryDeltaReader::Record> end;
+    {
+        const FileDescriptor out { ::open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+        if (out.fd < 0) {
+            throw std::runtime_error(fmt::format("Cannot create file {}!", tmpName));
+        }
+
+        try {
+            Output output { out.fd, basisData };
+            while (auto record { reader.Next() }) {
+                if (record->m_type == BinaryDeltaReader::Record::Type::COPY) {
+                    const auto [begin, endOffset] { ChunkRange(record->m_firstChunk, record->m_numberOfChunks) };
+                    output.Copy(basis.fd, begin, endOffset - begin);
+                    // in LINE mode every copied line is terminated, even the last one of basis file
+                    if (lineMode && basisData[endOffset - 1] != '\n') {
+                        output.Write("\n");
+                    }
+                } else if (record->m_type == BinaryDeltaReader::Record::Type::LITERAL) {
+                    output.Write(record->m_literal);
+                } else {
+                    end = record;
+                }
+            }
+            output.Flush();
+
+            // updated file did not end with a line terminator which LINE mode added to its last line
+            if (lineMode && output.Written() == end->m_fileSize + 1) {
+                if (::ftruncate(out.fd, static_cast<off_t>(end->m_fileSize)) != 0) {
+                    throw std::runtime_error("Truncating patched file failed!");
+                }
+            } else if (output.Written() != end->m_fileSize) {
+                throw std::runtime_error("Patched file has wrong size!");
+            }
+        } catch (const std::exception& e) {
+            fail(e.what());
+        }
+    }
+
+    // verification pass over what actually landed on disk
+    if (xxhash64(InputFile { tmpName }.Data()) != end->m_checksum) {
+        fail(fmt::format("Patched file {} does not match the checksum stored in delta!", outFileName));
+    }
+    if (std::rename(tmpName.c_str(), outName.c_str()) != 0) {
+        fail(fmt::format("Cannot replace file {}!", outFileName));
+    }
+}
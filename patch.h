@@ -0,0 +1,36 @@
+#ifndef PATCH_H
+#define PATCH_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "deltaformat.h"
+#include "inputfile.h"
+
+namespace filediff {
+
+// Rebuilds updated file from the base file and a binary delta (see deltaformat.h). Copied ranges are moved between
+// files by the kernel (copy_file_range, sendfile as fallback), literals go through a write buffer. Result is checked
+// against size and checksum stored in the delta before it replaces the output file; LINE mode deltas whose copies were
+// not verified by strong hashes are refused as soon as the delta is opened.
+class Patch
+{
+public:
+    Patch(std::string_view basisFileName, std::string_view deltaFileName);
+
+    void Apply(std::string_view outFileName);
+
+private:
+    // byte range of given chunks in basis file
+    std::pair<uint64_t, uint64_t> ChunkRange(uint64_t firstChunk, uint64_t numberOfChunks) const;
+
+    std::string_view m_basisFileName;
+    InputFile m_basis;
+    InputFile m_delta;
+    BinaryDeltaReader::Header m_header;
+    std::vector<uint64_t> m_chunkOffsets; // LINE and CDC mode, start of every chunk followed by size of basis file
+};
+
+} // filediff
+#endif // PATCH_H
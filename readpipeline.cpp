@@ -0,0 +1,407 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#if defined(SYS_io_uring_setup) && defined(SYS_io_uring_enter)
+#define FILEDIFF_IO_URING
+#endif
+#endif
+
+#include <fmt/core.h>
+
+#include "readpipeline.h"
+#include "stats.h"
+
+#ifdef FILEDIFF_IO_URING
+// Minimal io_uring driven through raw system calls (no liburing needed): one submission queue entry per read, at most
+// as many reads in flight as there are entries, so neither queue can overflow.
+class filediff::ReadPipeline::Ring
+{
+public:
+    // nothing when kernel lacks io_uring, forbids it or is too old for IORING_OP_READ (added together with
+    // IORING_FEAT_RW_CUR_POS in 5.6)
+    static std::unique_ptr<Ring> Create(unsigned entries)
+    {
+        io_uring_params params {};
+        const auto fd { static_cast<int>(::syscall(SYS_io_uring_setup, entries, &params)) };
+        if (fd < 0) {
+            return nullptr;
+        }
+        std::unique_ptr<Ring> ring { new Ring { fd } };
+        if (!(params.features & IORING_FEAT_RW_CUR_POS) || !ring->Map(params)) {
+            return nullptr;
+        }
+        return ring;
+    }
+
+    ~Ring()
+    {
+        for (const auto& [mapping, size] : m_mappings) {
+            ::munmap(mapping, size);
+        }
+        ::close(m_fd);
+    }
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    void QueueRead(uint64_t tag, int fd, char* buffer, size_t length, uint64_t offset) noexcept
+    {
+        const auto tail { *m_sqTail };
+        const auto index { tail & *m_sqMask };
+        auto& entry { m_entries[index] };
+        std::memset(&entry, 0, sizeof(entry));
+        entry.opcode = IORING_OP_READ;
+        entry.fd = fd;
+        entry.addr = reinterpret_cast<uintptr_t>(buffer);
+        entry.len = static_cast<uint32_t>(length);
+        entry.off = offset;
+        entry.user_data = tag;
+        m_sqArray[index] = index;
+        std::atomic_ref { *m_sqTail }.store(tail + 1, std::memory_order_release);
+        m_unsubmitted++;
+    }
+
+    // submits queued reads and waits until at least one read completes
+    void SubmitAndWait()
+    {
+        while (true) {
+            const auto result { ::syscall(SYS_io_uring_enter, m_fd, m_unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0) };
+            if (result >= 0) {
+                m_unsubmitted -= std::min<unsigned>(m_unsubmitted, static_cast<unsigned>(result));
+                if (m_unsubmitted == 0) {
+                    return;
+                }
+            } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                throw std::runtime_error(fmt::format("io_uring submission failed: {}!", std::strerror(errno)));
+            }
+        }
+    }
+
+    // calls handler(tag, result) for every completed read
+    template <typename Handler>
+    void Reap(Handler&& handler)
+    {
+        auto head { *m_cqHead };
+        const auto tail { std::atomic_ref { *m_cqTail }.load(std::memory_order_acquire) };
+        for (; head != tail; ++head) {
+            const auto& completion { m_completions[head & *m_cqMask] };
+            const auto tag { completion.user_data };
+            const auto result { completion.res };
+            std::atomic_ref { *m_cqHead }.store(head + 1, std::memory_order_release);
+            handler(tag, result);
+        }
+    }
+
+private:
+    explicit Ring(int fd) noexcept
+        : m_fd { fd }
+    {
+    }
+
+    bool Map(const io_uring_params& params)
+    {
+        auto map = [this](size_t size, off_t offset) -> char* {
+            auto* mapping { ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset) };
+            if (mapping == MAP_FAILED) {
+                return nullptr;
+            }
+            m_mappings.emplace_back(mapping, size);
+            return static_cast<char*>(mapping);
+        };
+
+        auto submissionSize { params.sq_off.array + params.sq_entries * sizeof(uint32_t) };
+        auto completionSize { params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe) };
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            submissionSize = completionSize = std::max(submissionSize, completionSize);
+        }
+        auto* submission { map(submissionSize, IORING_OFF_SQ_RING) };
+        auto* completion { params.features & IORING_FEAT_SINGLE_MMAP ? submission : map(completionSize, IORING_OFF_CQ_RING) };
+        auto* entries { map(params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES) };
+        if (!submission || !completion || !entries) {
+            return false;
+        }
+
+        m_sqTail = reinterpret_cast<uint32_t*>(submission + params.sq_off.tail);
+        m_sqMask = reinterpret_cast<uint32_t*>(submission + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<uint32_t*>(submission + params.sq_off.array);
+        m_entries = reinterpret_cast<io_uring_sqe*>(entries);
+        m_cqHead = reinterpret_cast<uint32_t*>(completion + params.cq_off.head);
+        m_cqTail = reinterpret_cast<uint32_t*>(completion + params.cq_off.tail);
+        m_cqMask = reinterpret_cast<uint32_t*>(completion + params.cq_off.ring_mask);
+        m_completions = reinterpret_cast<io_uring_cqe*>(completion + params.cq_off.cqes);
+        return true;
+    }
+
+    int m_fd;
+    std::vector<std::pair<void*, size_t>> m_mappings;
+    uint32_t* m_sqTail { nullptr };
+    uint32_t* m_sqMask { nullptr };
+    uint32_t* m_sqArray { nullptr };
+    io_uring_sqe* m_entries { nullptr };
+    uint32_t* m_cqHead { nullptr };
+    uint32_t* m_cqTail { nullptr };
+    uint32_t* m_cqMask { nullptr };
+    io_uring_cqe* m_completions { nullptr };
+    unsigned m_unsubmitted { 0 };
+};
+#else
+// io_uring is not available on this platform, the reader thread is always used
+class filediff::ReadPipeline::Ring
+{
+public:
+    static std::unique_ptr<Ring> Create(unsigned) { return nullptr; }
+
+    void QueueRead(uint64_t, int, char*, size_t, uint64_t) noexcept { }
+
+    void SubmitAndWait() { }
+
+    template <typename Handler>
+    void Reap(Handler&&) { }
+};
+#endif
+
+void filediff::PageAlignedDeleter::operator()(char* buffer) const noexcept
+{
+    ::operator delete[](buffer, std::align_val_t { READ_BUFFER_ALIGNMENT });
+}
+
+filediff::PageAlignedBuffer filediff::MakePageAligned(size_t size)
+{
+    return PageAlignedBuffer { static_cast<char*>(::operator new[](size, std::align_val_t { READ_BUFFER_ALIGNMENT })) };
+}
+
+filediff::ReadPipeline::ReadPipeline(std::string_view path, Backend backend, size_t bufferSize, size_t depth)
+    : m_path { path }
+    , m_fd { ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC) }
+    , m_ownsFd { true }
+    , m_bufferSize { bufferSize }
+    , m_depth { depth }
+{
+    if (m_fd < 0) {
+        throw std::runtime_error(fmt::format("File {} not found!", path));
+    }
+    try {
+        m_buffers = MakePageAligned(m_bufferSize * m_depth);
+        Start(backend);
+    } catch (...) {
+        ::close(m_fd);
+        throw;
+    }
+}
+
+filediff::ReadPipeline::ReadPipeline(int fd, std::string_view path, std::span<char> destination, Backend backend,
+    size_t bufferSize, size_t depth)
+    : m_path { path }
+    , m_fd { fd }
+    , m_bufferSize { bufferSize }
+    , m_depth { depth }
+    , m_destination { destination }
+{
+    Start(backend);
+}
+
+filediff::ReadPipeline::~ReadPipeline()
+{
+    if (m_reader.joinable()) {
+        {
+            std::lock_guard lock { m_mutex };
+            m_stopping = true;
+        }
+        m_condition.notify_all();
+        m_reader.join();
+    }
+    // kernel must not write into buffers after they are freed
+    while (m_inFlight > 0) {
+        m_ring->SubmitAndWait();
+        m_ring->Reap([this](uint64_t, int32_t) { m_inFlight--; });
+    }
+    if (m_ownsFd) {
+        ::close(m_fd);
+    }
+}
+
+void filediff::ReadPipeline::Start(Backend backend)
+{
+    if (m_bufferSize == 0 || m_depth == 0) {
+        throw std::invalid_argument("Read pipeline needs at least one non-empty buffer!");
+    }
+    struct stat status { };
+    m_regular = ::fstat(m_fd, &status) == 0 && S_ISREG(status.st_mode);
+    if (!m_buffers && !m_regular) {
+        throw std::invalid_argument(fmt::format("File {} is not a regular file!", m_path));
+    }
+    m_size = m_buffers ? static_cast<uint64_t>(status.st_size) : m_destination.size();
+    m_pieceSizes.assign(m_depth, 0);
+    if (m_regular) {
+        ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    // reads at explicit offsets would not keep order of a stream, pipes and the like are left to the reader thread
+    if (backend == Backend::AUTO && m_regular) {
+        m_ring = Ring::Create(static_cast<unsigned>(m_depth));
+    }
+    if (m_ring) {
+        m_done.assign(m_depth, false);
+    } else {
+        m_reader = std::thread { [this] { ReaderLoop(); } };
+    }
+}
+
+bool filediff::ReadPipeline::UsesIoUring() const noexcept
+{
+    return m_ring != nullptr;
+}
+
+char* filediff::ReadPipeline::Buffer(uint64_t piece) const noexcept
+{
+    if (!m_buffers) {
+        return m_destination.data() + piece * m_bufferSize;
+    }
+    return m_buffers.get() + piece % m_depth * m_bufferSize;
+}
+
+size_t filediff::ReadPipeline::Capacity(uint64_t piece) const noexcept
+{
+    if (!m_regular) {
+        return m_bufferSize;
+    }
+    const auto offset { piece * m_bufferSize };
+    return offset < m_size ? static_cast<size_t>(std::min<uint64_t>(m_bufferSize, m_size - offset)) : 0;
+}
+
+std::string_view filediff::ReadPipeline::Next()
+{
+    if (m_finished) {
+        return {};
+    }
+    const auto piece { m_ring ? NextFromRing() : NextFromReader() };
+    m_next++;
+    // the first empty piece marks the end, a short one may be followed only by it (file shrank while it was read)
+    m_finished = piece.empty();
+    FILEDIFF_STATS_ADD(BYTES_READ, piece.size());
+    return piece;
+}
+
+void filediff::ReadPipeline::QueueRead(uint64_t piece)
+{
+    const auto done { m_pieceSizes[piece % m_depth] };
+    m_ring->QueueRead(piece, m_fd, Buffer(piece) + done, Capacity(piece) - done, piece * m_bufferSize + done);
+    m_inFlight++;
+}
+
+void filediff::ReadPipeline::QueueReads()
+{
+    // buffer of the piece handed out last is given back now, the ring is full again
+    for (; m_queued < m_next + m_depth && Capacity(m_queued) > 0; ++m_queued) {
+        m_pieceSizes[m_queued % m_depth] = 0;
+        m_done[m_queued % m_depth] = false;
+        QueueRead(m_queued);
+    }
+}
+
+std::string_view filediff::ReadPipeline::NextFromRing()
+{
+    QueueReads();
+    if (m_next >= m_queued) {
+        return {};
+    }
+
+    const auto slot { m_next % m_depth };
+    while (!m_done[slot]) {
+        m_ring->SubmitAndWait();
+        std::exception_ptr error;
+        m_ring->Reap([&](uint64_t piece, int32_t result) {
+            m_inFlight--;
+            auto& size { m_pieceSizes[piece % m_depth] };
+            if (result == -EINTR || result == -EAGAIN) {
+                QueueRead(piece);
+            } else if (result < 0) {
+                error = std::make_exception_ptr(std::runtime_error(fmt::format("Reading file {} failed: {}!", m_path, std::strerror(-result))));
+                m_done[piece % m_depth] = true;
+            } else if (result == 0 || (size += static_cast<size_t>(result)) == Capacity(piece)) {
+                m_done[piece % m_depth] = true;
+            } else {
+                QueueRead(piece); // short read, the rest of the piece is asked for again
+            }
+        });
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    return { Buffer(m_next), m_pieceSizes[slot] };
+}
+
+std::string_view filediff::ReadPipeline::NextFromReader()
+{
+    std::unique_lock lock { m_mutex };
+    m_released = m_next;
+    m_condition.notify_all();
+    m_condition.wait(lock, [this] { return m_completed > m_next || m_error; });
+    if (m_completed <= m_next) {
+        std::rethrow_exception(m_error);
+    }
+    return { Buffer(m_next), m_pieceSizes[m_next % m_depth] };
+}
+
+void filediff::ReadPipeline::ReaderLoop()
+{
+    try {
+        for (uint64_t piece { 0 };; ++piece) {
+            {
+                std::unique_lock lock { m_mutex };
+                m_condition.wait(lock, [&] { return m_stopping || piece < m_released + m_depth; });
+                if (m_stopping) {
+                    return;
+                }
+            }
+
+            auto* buffer { Buffer(piece) };
+            const auto capacity { Capacity(piece) };
+            size_t size { 0 };
+            while (size < capacity) {
+                const auto result { m_regular ? ::pread(m_fd, buffer + size, capacity - size, static_cast<off_t>(piece * m_bufferSize + size))
+                                              : ::read(m_fd, buffer + size, capacity - size) };
+                if (result < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (result < 0) {
+                    throw std::runtime_error(fmt::format("Reading file {} failed: {}!", m_path, std::strerror(errno)));
+                }
+                if (result == 0) {
+                    break;
+                }
+                size += static_cast<size_t>(result);
+            }
+
+            {
+                std::lock_guard lock { m_mutex };
+                m_pieceSizes[piece % m_depth] = size;
+                m_completed = piece + 1;
+            }
+            m_condition.notify_all();
+            if (size == 0) {
+                return;
+            }
+        }
+    } catch (const std::exception&) {
+        {
+            std::lock_guard lock { m_mutex };
+            m_error = std::current_exception();
+        }
+        m_condition.notify_all();
+    }
+}
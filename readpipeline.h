@@ -0,0 +1,106 @@
+#ifndef READPIPELINE_H
+#define READPIPELINE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace filediff {
+
+// read buffers start at page boundary, so reads fill whole pages and the kernel copies page to page
+constexpr size_t READ_BUFFER_ALIGNMENT { 4096 };
+
+struct PageAlignedDeleter {
+    void operator()(char* buffer) const noexcept;
+};
+
+using PageAlignedBuffer = std::unique_ptr<char[], PageAlignedDeleter>;
+
+// uninitialized buffer of size bytes aligned to READ_BUFFER_ALIGNMENT
+PageAlignedBuffer MakePageAligned(size_t size);
+
+// Reads a file front to back keeping several large reads in flight, so that processing of one piece overlaps reading
+// of the next ones instead of alternating with it. Reads are queued to io_uring where the kernel supports it (regular
+// files only), otherwise a reader thread fills the buffers with read(2). Pieces come in file order, only the last one
+// may be shorter than buffer size.
+class ReadPipeline
+{
+public:
+    static constexpr size_t DEFAULT_BUFFER_SIZE { 4 << 20 };
+    static constexpr size_t DEFAULT_DEPTH { 4 };
+
+    enum class Backend {
+        AUTO, // io_uring if available, reader thread otherwise
+        THREAD
+    };
+
+    // file is read through a ring of depth buffers of bufferSize bytes, a piece is overwritten once it is given back
+    explicit ReadPipeline(std::string_view path, Backend backend = Backend::AUTO, size_t bufferSize = DEFAULT_BUFFER_SIZE,
+        size_t depth = DEFAULT_DEPTH);
+
+    // first destination.size() bytes of open regular file fd (not closed by the pipeline, path names it in errors) are
+    // read straight into destination, pieces are views into it and stay valid as long as destination does
+    ReadPipeline(int fd, std::string_view path, std::span<char> destination, Backend backend = Backend::AUTO,
+        size_t bufferSize = DEFAULT_BUFFER_SIZE, size_t depth = DEFAULT_DEPTH);
+
+    ~ReadPipeline();
+
+    ReadPipeline(const ReadPipeline&) = delete;
+    ReadPipeline& operator=(const ReadPipeline&) = delete;
+
+    // next piece of the file, empty at the end of it; with ring buffers the piece stays valid until the following call
+    std::string_view Next();
+
+    bool UsesIoUring() const noexcept;
+
+private:
+    class Ring;
+
+    void Start(Backend backend);
+    char* Buffer(uint64_t piece) const noexcept;
+    size_t Capacity(uint64_t piece) const noexcept;
+    void ReaderLoop();
+    std::string_view NextFromRing();
+    std::string_view NextFromReader();
+    void QueueReads();
+    void QueueRead(uint64_t piece);
+
+    std::string m_path;
+    int m_fd { -1 };
+    bool m_ownsFd { false };
+    bool m_regular { false };
+    uint64_t m_size { 0 }; // of regular file, reads stop there
+    size_t m_bufferSize;
+    size_t m_depth;
+    PageAlignedBuffer m_buffers; // depth buffers, empty when reading into destination
+    std::span<char> m_destination;
+    uint64_t m_next { 0 }; // piece handed out by the next call of Next()
+    bool m_finished { false };
+
+    std::vector<size_t> m_pieceSizes; // bytes read into every buffer, indexed by piece % depth
+
+    // io_uring backend
+    std::unique_ptr<Ring> m_ring;
+    std::vector<bool> m_done; // indexed by piece % depth
+    uint64_t m_queued { 0 }; // pieces whose reads were queued
+    size_t m_inFlight { 0 }; // reads the kernel may still write into buffers
+
+    // reader thread backend, everything below m_mutex is guarded by it
+    std::thread m_reader;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    uint64_t m_completed { 0 };
+    uint64_t m_released { 0 }; // pieces whose buffers may be refilled
+    std::exception_ptr m_error;
+    bool m_stopping { false };
+};
+
+} // filediff
+#endif // READPIPELINE_H
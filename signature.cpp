@@ -1,48 +1,553 @@
-#include <fstream>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <future>
+#include <numeric>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <fmt/core.h>
 
 #include "adler32.h"
+#include "inputfile.h"
+#include "readpipeline.h"
 #include "signature.h"
+#include "stats.h"
+#include "threadpool.h"
+#include "xxhash64.h"
 
-filediff::Signature::Signature(std::string_view path, InputFileType fileType)
+namespace {
+
+struct PartitionHashes {
+    std::vector<uint32_t> m_hashes;
+    std::vector<uint64_t> m_strongHashes;
+    size_t m_length { 0 }; // of the hashed chunks from the beginning of data
+};
+
+// when more data follows (last is false) the final chunk is left out if it could still go on in that data
+PartitionHashes HashPartition(std::string_view data, const filediff::Signature::Metadata& metadata, bool strongHashes, bool last = true)
+{
+    PartitionHashes result;
+    filediff::ChunkReader reader { data };
+    if (metadata.m_mode == filediff::Signature::ChunkingMode::BLOCK) {
+        while (const auto block { reader.NextBlock(metadata.m_chunkLenght) }) {
+            if (!last && block->size() < metadata.m_chunkLenght) {
+                break;
+            }
+            result.m_hashes.push_back(filediff::adler32(*block));
+            result.m_strongHashes.push_back(filediff::xxhash64(*block));
+            result.m_length = reader.Position();
+        }
+    } else if (metadata.m_mode == filediff::Signature::ChunkingMode::CDC) {
+        const auto parameters { metadata.GetCdcParameters() };
+        while (const auto chunk { reader.NextChunk(parameters) }) {
+            if (!last && reader.Position() == data.size() && chunk->size() < parameters.m_maxLength) {
+                break;
+            }
+            result.m_hashes.push_back(filediff::adler32(*chunk));
+            result.m_strongHashes.push_back(filediff::xxhash64(*chunk));
+            result.m_length = reader.Position();
+        }
+    } else {
+        while (const auto line { reader.NextLine() }) {
+            if (!last && line->data() + line->size() == data.data() + data.size()) {
+                break; // not terminated yet
+            }
+            result.m_hashes.push_back(filediff::adler32(*line));
+            if (strongHashes) {
+                result.m_strongHashes.push_back(filediff::xxhash64(*line));
+            }
+            result.m_length = reader.Position();
+        }
+    }
+    return result;
+}
+
+// bytes at the beginning of piece which complete the chunk carried over from previous pieces, or the whole piece
+size_t BridgeLength(size_t carried, std::string_view piece, const filediff::Signature::Metadata& metadata) noexcept
+{
+    if (metadata.m_mode == filediff::Signature::ChunkingMode::BLOCK) {
+        return std::min<size_t>(piece.size(), metadata.m_chunkLenght - carried);
+    }
+    if (metadata.m_mode == filediff::Signature::ChunkingMode::CDC) {
+        return std::min<size_t>(piece.size(), metadata.m_maxChunkLength - carried);
+    }
+    const auto newline { piece.find('\n') };
+    return newline == std::string_view::npos ? piece.size() : newline + 1;
+}
+
+constexpr size_t HEADER_SIZE { 64 };
+constexpr size_t CHECKSUM_OFFSET { 48 };
+constexpr size_t CHECKSUM_END { 56 };
+
+// layouts of signature files written before the versioned format: raw Metadata followed by host order hashes, the
+// first one (line chunks only, no file size) and the one of block mode signatures
+struct BaselineMetadata {
+    size_t m_numberOfChunks;
+    uint32_t m_chunkLenght;
+};
+
+struct LegacyMetadata {
+    size_t m_numberOfChunks;
+    uint32_t m_chunkLenght;
+    filediff::Signature::ChunkingMode m_mode;
+    uint64_t m_fileSize;
+};
+
+struct FileLayout {
+    uint64_t m_hashesOffset;
+    uint64_t m_strongHashesOffset;
+    uint64_t m_size;
+};
+
+FileLayout Layout(uint64_t numberOfChunks, bool hasStrongHashes)
+{
+    const auto hashesEnd { HEADER_SIZE + numberOfChunks * sizeof(uint32_t) };
+    if (!hasStrongHashes) {
+        return { HEADER_SIZE, 0, hashesEnd };
+    }
+    const auto strongHashesOffset { (hashesEnd + alignof(uint64_t) - 1) / alignof(uint64_t) * alignof(uint64_t) };
+    return { HEADER_SIZE, strongHashesOffset, strongHashesOffset + numberOfChunks * sizeof(uint64_t) };
+}
+
+template<typename T>
+T LoadLittleEndian(std::string_view data, size_t offset)
+{
+    T value { 0 };
+    for (auto i { 0U }; i < sizeof(T); ++i) {
+        value |= static_cast<T>(static_cast<unsigned char>(data[offset + i])) << (8 * i);
+    }
+    return value;
+}
+
+template<typename T>
+void StoreLittleEndian(std::string& data, size_t offset, T value)
+{
+    for (auto i { 0U }; i < sizeof(T); ++i) {
+        data[offset + i] = static_cast<char>(value >> (8 * i));
+    }
+}
+
+// on little-endian hosts the hash array is already in file order, otherwise it is byte swapped
+template<typename T>
+std::string EncodeLittleEndian(std::span<const T> values)
+{
+    std::string bytes(values.size_bytes(), '\0');
+    if constexpr (std::endian::native == std::endian::little) {
+        std::memcpy(bytes.data(), values.data(), bytes.size());
+    } else {
+        for (auto i { 0U }; i < values.size(); ++i) {
+            StoreLittleEndian<T>(bytes, i * sizeof(T), values[i]);
+        }
+    }
+    return bytes;
+}
+
+// hashes are used straight from the mapped file when host order and alignment allow it, decoded otherwise
+template<typename T>
+std::span<const T> InPlaceOrDecoded(std::string_view bytes, std::vector<T>& decoded)
+{
+    const auto count { bytes.size() / sizeof(T) };
+    if (std::endian::native == std::endian::little && reinterpret_cast<uintptr_t>(bytes.data()) % alignof(T) == 0) {
+        return { reinterpret_cast<const T*>(bytes.data()), count };
+    }
+    decoded.resize(count);
+    for (auto i { 0U }; i < count; ++i) {
+        decoded[i] = LoadLittleEndian<T>(bytes, i * sizeof(T));
+    }
+    return decoded;
+}
+
+uint64_t Checksum(std::string_view header, uint32_t version, std::string_view hashes, std::string_view strongHashes, std::string_view tree)
+{
+    auto seed { filediff::xxhash64(header.substr(0, CHECKSUM_OFFSET)) };
+    if (version > 1) {
+        seed = filediff::xxhash64(header.substr(CHECKSUM_END, HEADER_SIZE - CHECKSUM_END), seed);
+    }
+    const auto checksum { filediff::xxhash64(strongHashes, filediff::xxhash64(hashes, seed)) };
+    return version > 2 ? filediff::xxhash64(tree, checksum) : checksum;
+}
+
+constexpr size_t TREE_HEADER_SIZE { 8 };
+
+// number of nodes of every hash tree level from the lowest one up to the root
+std::vector<uint64_t> TreeLevelSizes(uint64_t numberOfChunks, uint32_t fanout)
+{
+    std::vector<uint64_t> sizes;
+    for (auto count { numberOfChunks }; count > 1;) {
+        count = (count + fanout - 1) / fanout;
+        sizes.push_back(count);
+    }
+    return sizes;
+}
+
+// name of signature loaded from a buffer in error messages
+constexpr std::string_view IN_MEMORY_NAME { "<in-memory>" };
+
+filediff::Signature::Metadata BasisMetadata(filediff::Signature::ChunkingMode mode, uint32_t chunkLength, bool strongHashes)
+{
+    if (mode == filediff::Signature::ChunkingMode::BLOCK && chunkLength == 0) {
+        throw std::invalid_argument("Block size must be greater than 0!");
+    }
+    if (mode == filediff::Signature::ChunkingMode::CDC) {
+        throw std::invalid_argument("CDC signature needs chunk length limits!");
+    }
+    const auto block { mode == filediff::Signature::ChunkingMode::BLOCK };
+    return { 0, block ? chunkLength : 1, mode, 0, 0, 0, 0, strongHashes || block };
+}
+
+// hashes taken in place from a buffer are copied to storage, decoded ones are already there
+template<typename T>
+std::span<const T> Owned(std::span<const T> view, std::vector<T>& storage)
+{
+    if (view.data() != storage.data()) {
+        storage.assign(std::cbegin(view), std::cend(view));
+    }
+    return storage;
+}
+
+} // namespace
+
+filediff::Signature::Signature(std::string_view path, InputFileType fileType, ChunkingMode mode, uint32_t chunkLength, ThreadPool* pool,
+    bool strongHashes)
 {
     if(fileType == InputFileType::SIGNATURE) {
-        std::ifstream isf { path.data(), std::ios::binary };
-        if(!isf.is_open()) {
-            throw std::runtime_error(std::string { fmt::format("File {} not found!", path) });
+        FILEDIFF_STATS_PHASE("signature load");
+        m_file.emplace(path);
+        Load(m_file->Data(), path);
+    } else {
+        m_metadata = BasisMetadata(mode, chunkLength, strongHashes);
+        Calculate(path, pool, m_metadata.m_strongHashes);
+    }
+}
+
+filediff::Signature::Signature(std::string_view path, const CdcParameters& parameters, ThreadPool* pool)
+{
+    ValidateCdcParameters(parameters);
+    m_metadata = Metadata { 0, parameters.m_averageLength, ChunkingMode::CDC, 0, parameters.m_minLength, parameters.m_maxLength, 0, true };
+    Calculate(path, pool, true);
+}
+
+filediff::Signature::Signature(std::span<const std::byte> data, InputFileType fileType, ChunkingMode mode, uint32_t chunkLength,
+    ThreadPool* pool, bool strongHashes)
+{
+    const std::string_view bytes { reinterpret_cast<const char*>(data.data()), data.size() };
+    if (fileType == InputFileType::SIGNATURE) {
+        FILEDIFF_STATS_PHASE("signature load");
+        Load(bytes, IN_MEMORY_NAME);
+        // buffer belongs to the caller, hashes found in place are copied
+        m_hashView = Owned(m_hashView, m_hashes);
+        m_strongHashView = Owned(m_strongHashView, m_strongHashes);
+        m_treeView = Owned(m_treeView, m_tree);
+    } else {
+        m_metadata = BasisMetadata(mode, chunkLength, strongHashes);
+        CalculateInMemory(bytes, pool, m_metadata.m_strongHashes);
+    }
+}
+
+filediff::Signature::Signature(std::span<const std::byte> data, const CdcParameters& parameters, ThreadPool* pool)
+{
+    ValidateCdcParameters(parameters);
+    m_metadata = Metadata { 0, parameters.m_averageLength, ChunkingMode::CDC, 0, parameters.m_minLength, parameters.m_maxLength, 0, true };
+    CalculateInMemory({ reinterpret_cast<const char*>(data.data()), data.size() }, pool, true);
+}
+
+filediff::Signature::Signature(std::string_view path, const Signature& previous, uint64_t unchangedLength, ThreadPool* pool)
+{
+    Update(path, previous, unchangedLength, pool);
+}
+
+void filediff::Signature::Load(std::string_view data, std::string_view path)
+{
+    if (!data.starts_with(std::string_view { SIGNATURE_MAGIC.data(), SIGNATURE_MAGIC.size() })) {
+        LoadLegacy(data, path);
+        return;
+    }
+    if (data.size() < HEADER_SIZE) {
+        throw std::runtime_error(fmt::format("Signature file {} is truncated!", path));
+    }
+
+    const auto version { LoadLittleEndian<uint32_t>(data, 4) };
+    if (version == 0 || version > TREE_SIGNATURE_VERSION) {
+        throw std::runtime_error(fmt::format("Signature file {} has unsupported version {}!", path, version));
+    }
+    const auto mode { LoadLittleEndian<uint32_t>(data, 8) };
+    if (mode > static_cast<uint32_t>(ChunkingMode::CDC) || (version < 2 && mode == static_cast<uint32_t>(ChunkingMode::CDC))) {
+        throw std::runtime_error(fmt::format("Signature file {} is corrupted!", path));
+    }
+    m_metadata.m_mode = static_cast<ChunkingMode>(mode);
+    m_metadata.m_chunkLenght = LoadLittleEndian<uint32_t>(data, 12);
+    m_metadata.m_numberOfChunks = LoadLittleEndian<uint64_t>(data, 16);
+    m_metadata.m_fileSize = LoadLittleEndian<uint64_t>(data, 24);
+    const auto hashesOffset { LoadLittleEndian<uint64_t>(data, 32) };
+    const auto strongHashesOffset { LoadLittleEndian<uint64_t>(data, 40) };
+    const auto checksum { LoadLittleEndian<uint64_t>(data, CHECKSUM_OFFSET) };
+    if (m_metadata.m_mode == ChunkingMode::CDC) {
+        m_metadata.m_minChunkLength = LoadLittleEndian<uint32_t>(data, 56);
+        m_metadata.m_maxChunkLength = LoadLittleEndian<uint32_t>(data, 60);
+    }
+
+    // layout is fully determined by the header, anything else is a damaged file
+    const auto numberOfChunks { m_metadata.m_numberOfChunks };
+    const auto hasStrongHashes { strongHashesOffset != 0 };
+    m_metadata.m_strongHashes = hasStrongHashes;
+    const auto layout { Layout(numberOfChunks, hasStrongHashes) };
+    if ((m_metadata.m_mode != ChunkingMode::LINE && !hasStrongHashes) || hashesOffset != layout.m_hashesOffset
+        || strongHashesOffset != layout.m_strongHashesOffset
+        || numberOfChunks > data.size() / sizeof(uint32_t)) {
+        throw std::runtime_error(fmt::format("Signature file {} is corrupted!", path));
+    }
+    if (data.size() < layout.m_size) {
+        throw std::runtime_error(fmt::format("Signature file {} is truncated!", path));
+    }
+
+    // hash tree follows strong hashes of BLOCK mode signature
+    std::string_view treeBytes;
+    if (version > 2) {
+        if (m_metadata.m_mode != ChunkingMode::BLOCK) {
+            throw std::runtime_error(fmt::format("Signature file {} is corrupted!", path));
+        }
+        if (data.size() < layout.m_size + TREE_HEADER_SIZE) {
+            throw std::runtime_error(fmt::format("Signature file {} is truncated!", path));
+        }
+        m_metadata.m_treeFanout = LoadLittleEndian<uint32_t>(data, layout.m_size);
+        const auto levels { m_metadata.m_treeFanout < 2 ? std::vector<uint64_t> {} : TreeLevelSizes(numberOfChunks, m_metadata.m_treeFanout) };
+        if (m_metadata.m_treeFanout < 2 || LoadLittleEndian<uint32_t>(data, layout.m_size + 4) != levels.size()) {
+            throw std::runtime_error(fmt::format("Signature file {} is corrupted!", path));
         }
+        const auto numberOfNodes { std::accumulate(std::cbegin(levels), std::cend(levels), uint64_t { 0 }) };
+        if (data.size() < layout.m_size + TREE_HEADER_SIZE + numberOfNodes * sizeof(uint64_t)) {
+            throw std::runtime_error(fmt::format("Signature file {} is truncated!", path));
+        }
+        treeBytes = data.substr(layout.m_size, TREE_HEADER_SIZE + numberOfNodes * sizeof(uint64_t));
+    }
 
-        isf.read(reinterpret_cast<char*>(&m_metadata), sizeof(decltype (m_metadata)));
+    const auto hashBytes { data.substr(hashesOffset, numberOfChunks * sizeof(uint32_t)) };
+    const auto strongHashBytes { hasStrongHashes ? data.substr(strongHashesOffset, numberOfChunks * sizeof(uint64_t)) : std::string_view {} };
+    if (Checksum(data.substr(0, HEADER_SIZE), version, hashBytes, strongHashBytes, treeBytes) != checksum) {
+        throw std::runtime_error(fmt::format("Signature file {} is corrupted!", path));
+    }
 
-        while (true) {
-            uint32_t hash;
-            isf.read(reinterpret_cast<char*>(&hash), sizeof(decltype (hash)));
+    m_hashView = InPlaceOrDecoded(hashBytes, m_hashes);
+    m_strongHashView = InPlaceOrDecoded(strongHashBytes, m_strongHashes);
+    m_treeView = InPlaceOrDecoded(treeBytes.substr(std::min(treeBytes.size(), TREE_HEADER_SIZE)), m_tree);
+}
 
-            if(isf.eof()) {
-                break;
+void filediff::Signature::LoadLegacy(std::string_view data, std::string_view path)
+{
+    // readable only on the platform which wrote it, the two layouts differ in size of the metadata
+    BaselineMetadata baseline {};
+    if (data.size() >= sizeof(BaselineMetadata)) {
+        std::memcpy(&baseline, data.data(), sizeof(BaselineMetadata));
+    }
+    if (data.size() >= sizeof(BaselineMetadata) && baseline.m_numberOfChunks <= data.size() / sizeof(uint32_t)
+        && data.size() == sizeof(BaselineMetadata) + baseline.m_numberOfChunks * sizeof(uint32_t)) {
+        // line chunks, size of the file was not stored; hashes were summed over signed chars into int, so a line
+        // with bytes above 0x7F or long enough to overflow has a hash which current adler32 never gives and it comes
+        // out of delta as removed and new (only ASCII lines shorter than about 5 KB match)
+        data.remove_prefix(sizeof(BaselineMetadata));
+        m_metadata = Metadata { baseline.m_numberOfChunks, baseline.m_chunkLenght, ChunkingMode::LINE, 0 };
+    } else {
+        // block mode signatures have strong hashes after the adler32 ones, any other content is not a signature
+        // of either layout (or one written with the metadata widened again)
+        LegacyMetadata legacy {};
+        if (data.size() >= sizeof(LegacyMetadata)) {
+            std::memcpy(&legacy, data.data(), sizeof(LegacyMetadata));
+        }
+        const auto hashesSize { legacy.m_mode == ChunkingMode::BLOCK ? sizeof(uint32_t) + sizeof(uint64_t) : sizeof(uint32_t) };
+        const auto valid { data.size() >= sizeof(LegacyMetadata)
+            && (legacy.m_mode == ChunkingMode::LINE ? legacy.m_chunkLenght == 1
+                                                    : legacy.m_mode == ChunkingMode::BLOCK && legacy.m_chunkLenght != 0)
+            && legacy.m_numberOfChunks <= data.size() / hashesSize
+            && data.size() == sizeof(LegacyMetadata) + legacy.m_numberOfChunks * hashesSize };
+        if (!valid) {
+            throw std::runtime_error(fmt::format("Signature file {} has no version header and does not match any earlier layout, "
+                                                 "it is damaged or written by an unsupported version; calculate it again!",
+                path));
+        }
+        data.remove_prefix(sizeof(LegacyMetadata));
+        m_metadata = Metadata { legacy.m_numberOfChunks, legacy.m_chunkLenght, legacy.m_mode, legacy.m_fileSize };
+    }
+
+    const auto hasStrongHashes { m_metadata.m_mode == ChunkingMode::BLOCK };
+    const auto numberOfChunks { m_metadata.m_numberOfChunks };
+    m_metadata.m_strongHashes = hasStrongHashes;
+
+    m_hashes.resize(numberOfChunks);
+    std::memcpy(m_hashes.data(), data.data(), numberOfChunks * sizeof(uint32_t));
+    if (hasStrongHashes) {
+        m_strongHashes.resize(numberOfChunks);
+        std::memcpy(m_strongHashes.data(), data.data() + numberOfChunks * sizeof(uint32_t), numberOfChunks * sizeof(uint64_t));
+    }
+    m_hashView = m_hashes;
+    m_strongHashView = m_strongHashes;
+    m_file.reset();
+}
+
+void filediff::Signature::Calculate(std::string_view path, ThreadPool* pool, bool strongHashes)
+{
+    FILEDIFF_STATS_PHASE("signature hashing");
+    // pieces are hashed while the following ones are being read, a chunk cut by the end of a piece is completed in
+    // carry from the beginning of the next one
+    ReadPipeline input { path };
+    std::string carry;
+    uint64_t fileSize { 0 };
+    for (auto piece { input.Next() }; !piece.empty(); piece = input.Next()) {
+        fileSize += piece.size();
+        if (!carry.empty()) {
+            const auto carried { carry.size() };
+            const auto bridge { piece.substr(0, BridgeLength(carried, piece, m_metadata)) };
+            carry.append(bridge);
+            // carried line has no terminator, it is complete only when the bridge ends with one, so a long line is
+            // not searched again for every piece appended to it
+            const auto lineOpen { m_metadata.m_mode == ChunkingMode::LINE && !bridge.ends_with('\n') };
+            const auto hashed { lineOpen ? 0 : CalculateComplete(carry, nullptr, strongHashes) };
+            if (hashed == 0) {
+                continue; // whole piece went to carry
             }
+            piece.remove_prefix(hashed - carried);
+            carry.clear();
+        }
+        carry.assign(piece.substr(CalculateComplete(piece, pool, strongHashes)));
+    }
+    CalculatePartitions(carry, nullptr, strongHashes);
+    Finish(fileSize);
+}
+
+void filediff::Signature::CalculateInMemory(std::string_view data, ThreadPool* pool, bool strongHashes)
+{
+    FILEDIFF_STATS_PHASE("signature hashing");
+    CalculatePartitions(data, pool, strongHashes);
+    Finish(data.size());
+}
+
+void filediff::Signature::Finish(uint64_t fileSize)
+{
+    m_metadata.m_fileSize = fileSize;
+    m_metadata.m_numberOfChunks = m_hashes.size();
+    FILEDIFF_STATS_ADD(CHUNKS_HASHED, m_hashes.size());
+    m_hashView = m_hashes;
+    m_strongHashView = m_strongHashes;
+}
+
+size_t filediff::Signature::CalculateComplete(std::string_view data, ThreadPool* pool, bool strongHashes)
+{
+    // CDC boundaries are known only after scanning, chunks are hashed during the same pass
+    if (m_metadata.m_mode == ChunkingMode::CDC) {
+        const auto partition { HashPartition(data, m_metadata, strongHashes, false) };
+        m_hashes.insert(std::end(m_hashes), std::cbegin(partition.m_hashes), std::cend(partition.m_hashes));
+        m_strongHashes.insert(std::end(m_strongHashes), std::cbegin(partition.m_strongHashes), std::cend(partition.m_strongHashes));
+        return partition.m_length;
+    }
+
+    const auto newline { m_metadata.m_mode == ChunkingMode::LINE ? data.rfind('\n') : std::string_view::npos };
+    const auto length { m_metadata.m_mode == ChunkingMode::BLOCK ? data.size() - data.size() % m_metadata.m_chunkLenght
+                            : newline == std::string_view::npos ? 0 : newline + 1 };
+    CalculatePartitions(data.substr(0, length), pool, strongHashes);
+    return length;
+}
+
+void filediff::Signature::CalculatePartitions(std::string_view data, ThreadPool* pool, bool strongHashes)
+{
+    const auto& metadata { m_metadata };
+    const auto mode { m_metadata.m_mode };
+    auto append = [this](const PartitionHashes& partition) {
+        m_hashes.insert(std::end(m_hashes), std::cbegin(partition.m_hashes), std::cend(partition.m_hashes));
+        m_strongHashes.insert(std::end(m_strongHashes), std::cbegin(partition.m_strongHashes), std::cend(partition.m_strongHashes));
+    };
 
-            m_hashes.emplace_back(hash);
+    // CDC boundaries depend on everything before them, such file cannot be cut into independent partitions
+    const auto numberOfPartitions { mode == ChunkingMode::CDC ? 1 : NumberOfPartitions(data.size(), pool) };
+    if (numberOfPartitions < 2) {
+        append(HashPartition(data, metadata, strongHashes));
+        return;
+    }
+
+    std::vector<std::future<PartitionHashes>> results;
+    for (const auto partition : SplitIntoPartitions(data, numberOfPartitions, mode == ChunkingMode::BLOCK ? metadata.m_chunkLenght : 0)) {
+        results.push_back(pool->Submit([=, &metadata] { return HashPartition(partition, metadata, strongHashes); }));
+    }
+    // results are collected in submission order which keeps hashes in file order
+    for (auto& result : results) {
+        append(result.get());
+    }
+}
+
+void filediff::Signature::Update(std::string_view path, const Signature& previous, uint64_t unchangedLength, ThreadPool* pool)
+{
+    FILEDIFF_STATS_PHASE("signature update");
+    const InputFile input { path };
+    const auto data { input.Data() };
+    const auto& metadata { previous.GetMetadata() };
+    if (unchangedLength > std::min<uint64_t>(metadata.m_fileSize, data.size())) {
+        throw std::invalid_argument(fmt::format("Unchanged length {} exceeds size of file {} or of the previous one!", unchangedLength, path));
+    }
+    m_metadata = metadata;
+    m_metadata.m_fileSize = data.size();
+
+    // chunks of previous signature which end within unchanged bytes are reused, the last one of them is kept aside
+    // for the check; a chunk ending right at the end of previous file is reused only if nothing could extend it
+    size_t reused { 0 };
+    size_t offset { 0 }; // where the first chunk to be hashed starts
+    std::string_view lastReused;
+    if (m_metadata.m_mode == ChunkingMode::BLOCK) {
+        reused = std::min<size_t>(unchangedLength / m_metadata.m_chunkLenght, metadata.m_numberOfChunks);
+        offset = reused * m_metadata.m_chunkLenght;
+        lastReused = reused ? data.substr(offset - m_metadata.m_chunkLenght, m_metadata.m_chunkLenght) : std::string_view {};
+    } else if (m_metadata.m_mode == ChunkingMode::CDC) {
+        ChunkReader reader { data };
+        const auto parameters { m_metadata.GetCdcParameters() };
+        while (reused < metadata.m_numberOfChunks) {
+            const auto chunk { reader.NextChunk(parameters) };
+            if (!chunk || reader.Position() > unchangedLength || reader.Position() == metadata.m_fileSize) {
+                break;
+            }
+            lastReused = *chunk;
+            offset = reader.Position();
+            reused++;
         }
     } else {
-        std::ifstream isf { path.data() };
-        if(!isf.is_open()) {
-            throw std::runtime_error(fmt::format("File {} not found!", path));
+        // only terminated lines are complete, the last one of unchanged bytes may go on after them
+        const auto unchanged { data.substr(0, unchangedLength) };
+        const auto lineEnd { unchanged.rfind('\n') };
+        offset = lineEnd == std::string_view::npos ? 0 : lineEnd + 1;
+        reused = unchangedLength == metadata.m_fileSize ? metadata.m_numberOfChunks - (offset < unchangedLength ? 1 : 0)
+                                                        : static_cast<size_t>(std::count(unchanged.begin(), unchanged.begin() + offset, '\n'));
+        reused = std::min(reused, metadata.m_numberOfChunks);
+        if (reused) {
+            const auto lastStart { offset > 1 ? unchanged.rfind('\n', offset - 2) : std::string_view::npos };
+            const auto start { lastStart == std::string_view::npos ? 0 : lastStart + 1 };
+            lastReused = data.substr(start, offset - 1 - start);
         }
+    }
+    if (reused && adler32(lastReused) != previous.GetHashes()[reused - 1]) {
+        throw std::runtime_error(fmt::format("File {} does not start with the content previous signature was calculated for!", path));
+    }
 
-        std::string line;
-        while(std::getline(isf, line)) {
-            m_hashes.push_back(adler32(line));
-        }
-        m_metadata = Metadata{m_hashes.size(), 1};
+    const auto strongHashes { metadata.m_strongHashes };
+    m_hashes.assign(previous.GetHashes().begin(), previous.GetHashes().begin() + reused);
+    if (strongHashes) {
+        m_strongHashes.assign(previous.GetStrongHashes().begin(), previous.GetStrongHashes().begin() + reused);
+    }
+    CalculatePartitions(data.substr(offset), pool, strongHashes);
+    m_metadata.m_numberOfChunks = m_hashes.size();
+    FILEDIFF_STATS_ADD(CHUNKS_HASHED, m_hashes.size() - reused);
+    m_hashView = m_hashes;
+    m_strongHashView = m_strongHashes;
+    if (m_metadata.m_treeFanout != 0) {
+        AddTree(m_metadata.m_treeFanout);
     }
 }
 
-const std::deque<uint32_t>& filediff::Signature::GetHashes() const noexcept
+std::span<const uint32_t> filediff::Signature::GetHashes() const noexcept
 {
-    return m_hashes;
+    return m_hashView;
+}
+
+std::span<const uint64_t> filediff::Signature::GetStrongHashes() const noexcept
+{
+    return m_strongHashView;
 }
 
 const filediff::Signature::Metadata& filediff::Signature::GetMetadata() const noexcept
@@ -50,10 +555,98 @@ const filediff::Signature::Metadata& filediff::Signature::GetMetadata() const no
     return m_metadata;
 }
 
+void filediff::Signature::AddTree(uint32_t fanout)
+{
+    if (m_metadata.m_mode != ChunkingMode::BLOCK) {
+        throw std::invalid_argument("Hash tree needs BLOCK mode signature!");
+    }
+    if (fanout < 2) {
+        throw std::invalid_argument("Hash tree fanout must be at least 2!");
+    }
+
+    const auto levels { TreeLevelSizes(m_strongHashView.size(), fanout) };
+    m_tree.clear();
+    m_tree.reserve(std::accumulate(std::cbegin(levels), std::cend(levels), size_t { 0 }));
+    auto children { m_strongHashView };
+    for (const auto numberOfNodes : levels) {
+        const auto first { m_tree.size() };
+        for (size_t node { 0 }; node < numberOfNodes; ++node) {
+            m_tree.push_back(TreeNodeHash(children.subspan(node * fanout, std::min<size_t>(fanout, children.size() - node * fanout))));
+        }
+        children = std::span<const uint64_t> { m_tree }.subspan(first, numberOfNodes);
+    }
+    m_treeView = m_tree;
+    m_metadata.m_treeFanout = fanout;
+}
+
+size_t filediff::Signature::GetTreeHeight() const noexcept
+{
+    size_t height { 0 };
+    for (auto count { m_strongHashView.size() }; m_metadata.m_treeFanout != 0 && count > 1; ++height) {
+        count = (count + m_metadata.m_treeFanout - 1) / m_metadata.m_treeFanout;
+    }
+    return height;
+}
+
+std::span<const uint64_t> filediff::Signature::GetTreeLevel(size_t level) const noexcept
+{
+    if (level == 0) {
+        return m_strongHashView;
+    }
+    size_t offset { 0 };
+    for (auto count { m_strongHashView.size() }; m_metadata.m_treeFanout != 0 && count > 1; --level) {
+        count = (count + m_metadata.m_treeFanout - 1) / m_metadata.m_treeFanout;
+        if (level == 1) {
+            return m_treeView.subspan(offset, count);
+        }
+        offset += count;
+    }
+    return {};
+}
+
 void filediff::Signature::Serialize(std::ostream& out) const
 {
-    out.write(reinterpret_cast<const char*>(&m_metadata), sizeof(decltype(m_metadata)));
-    for(auto elem : m_hashes) {
-        out.write(reinterpret_cast<char*>(&elem), sizeof(decltype(elem)));
+    const auto hasStrongHashes { m_metadata.m_strongHashes };
+    const auto layout { Layout(m_hashView.size(), hasStrongHashes) };
+    const auto hashBytes { EncodeLittleEndian(m_hashView) };
+    const auto strongHashBytes { EncodeLittleEndian(m_strongHashView) };
+    const auto version { m_metadata.m_treeFanout != 0 ? TREE_SIGNATURE_VERSION : SIGNATURE_VERSION };
+    std::string tree;
+    if (m_metadata.m_treeFanout != 0) {
+        tree.assign(TREE_HEADER_SIZE, '\0');
+        StoreLittleEndian<uint32_t>(tree, 0, m_metadata.m_treeFanout);
+        StoreLittleEndian<uint32_t>(tree, 4, static_cast<uint32_t>(GetTreeHeight()));
+        tree += EncodeLittleEndian(m_treeView);
+    }
+
+    std::string header(HEADER_SIZE, '\0');
+    std::memcpy(header.data(), SIGNATURE_MAGIC.data(), SIGNATURE_MAGIC.size());
+    StoreLittleEndian<uint32_t>(header, 4, version);
+    StoreLittleEndian<uint32_t>(header, 8, static_cast<uint32_t>(m_metadata.m_mode));
+    StoreLittleEndian<uint32_t>(header, 12, m_metadata.m_chunkLenght);
+    StoreLittleEndian<uint64_t>(header, 16, m_hashView.size());
+    StoreLittleEndian<uint64_t>(header, 24, m_metadata.m_fileSize);
+    StoreLittleEndian<uint64_t>(header, 32, layout.m_hashesOffset);
+    StoreLittleEndian<uint64_t>(header, 40, layout.m_strongHashesOffset);
+    StoreLittleEndian<uint32_t>(header, 56, m_metadata.m_minChunkLength);
+    StoreLittleEndian<uint32_t>(header, 60, m_metadata.m_maxChunkLength);
+    StoreLittleEndian<uint64_t>(header, CHECKSUM_OFFSET, Checksum(header, version, hashBytes, strongHashBytes, tree));
+
+    out.write(header.data(), header.size());
+    out.write(hashBytes.data(), hashBytes.size());
+    if (hasStrongHashes) {
+        const std::string padding(layout.m_strongHashesOffset - layout.m_hashesOffset - hashBytes.size(), '\0');
+        out.write(padding.data(), padding.size());
+        out.write(strongHashBytes.data(), strongHashBytes.size());
+    }
+    out.write(tree.data(), tree.size());
+}
+
+uint64_t filediff::TreeNodeHash(std::span<const uint64_t> children)
+{
+    if constexpr (std::endian::native == std::endian::little) {
+        return xxhash64({ reinterpret_cast<const char*>(children.data()), children.size_bytes() });
+    } else {
+        return xxhash64(EncodeLittleEndian(children));
     }
 }
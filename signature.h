@@ -1,18 +1,59 @@
 #ifndef SIGNATURE_H
 #define SIGNATURE_H
 
-#include <deque>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
 #include <sstream>
 #include <string_view>
+#include <vector>
+
+#include "inputfile.h"
 
 namespace filediff {
 
+class ThreadPool;
+
+// Signature file layout, all integers little-endian:
+//   header (64 bytes): "FDSG" magic, u32 version, u32 chunking mode, u32 chunk length, u64 number of chunks,
+//                      u64 size of base file, u64 offset of weak hashes, u64 offset of strong hashes (0 if none),
+//                      u64 XXH64 checksum of the rest of header and both hash arrays, u32 min and u32 max chunk length
+//                      (CDC mode only, zero otherwise; version 1 files had reserved u64 there, not covered by checksum)
+//   u32 weak hash for every chunk, starting at 64
+//   u64 strong hash for every chunk (always in BLOCK mode, optional in LINE mode), starting at the next 8 byte boundary
+//   version 3 only (BLOCK mode signature with hash tree): u32 tree fanout, u32 number of tree levels, then u64 nodes of
+//   every level from the lowest one up to the root, right after strong hashes; covered by checksum too
+// Arrays are aligned so a mapped signature file is used in place without parsing it. Signatures without hash tree are
+// written as version 2 so that builds not knowing the tree keep reading them.
+constexpr std::array<char, 4> SIGNATURE_MAGIC { 'F', 'D', 'S', 'G' };
+constexpr uint32_t SIGNATURE_VERSION { 2 };
+constexpr uint32_t TREE_SIGNATURE_VERSION { 3 };
+
 class Signature
 {
 public:
+    enum class ChunkingMode : uint32_t {
+        LINE, // every line is a chunk, chunk length is given in lines (always 1)
+        BLOCK, // fixed size blocks, chunk length is given in bytes, last block may be shorter
+        CDC // content-defined chunks (see cdc.h), chunk length is the average one in bytes
+    };
+
     struct Metadata {
         size_t m_numberOfChunks;
-        uint32_t m_chunkLenght; //in lines - as of now hard coded to 1
+        uint32_t m_chunkLenght; // in lines for LINE mode, in bytes for BLOCK mode, average in bytes for CDC mode
+        ChunkingMode m_mode;
+        uint64_t m_fileSize; // in bytes, lets BLOCK mode tell the length of last block
+        uint32_t m_minChunkLength { 0 }; // CDC mode only
+        uint32_t m_maxChunkLength { 0 }; // CDC mode only
+        uint32_t m_treeFanout { 0 }; // children of every hash tree node, 0 without tree
+        bool m_strongHashes { false }; // XXH64 of every chunk is stored, always but for LINE mode without it asked for
+
+        CdcParameters GetCdcParameters() const noexcept
+        {
+            return { m_minChunkLength, m_chunkLenght, m_maxChunkLength };
+        }
     };
 
     enum class InputFileType {
@@ -20,21 +61,81 @@ public:
         SIGNATURE
     };
 
-    // ctor taking path to signature file
-    Signature(std::string_view fileName, InputFileType fileType);
+    // ctor taking path to signature file, chunking parameters are used only for BASIS (signature file stores its own);
+    // when pool is given BASIS is split into partitions hashed in parallel, result is the same as for serial hashing
+    // signature files written before the versioned format (raw Metadata followed by hashes) are still accepted;
+    // strongHashes adds XXH64 of every line to LINE mode signature so delta can tell adler32 collisions from matches
+    Signature(std::string_view fileName, InputFileType fileType, ChunkingMode mode = ChunkingMode::LINE, uint32_t chunkLength = 1,
+        ThreadPool* pool = nullptr, bool strongHashes = false);
 
-    const std::deque<uint32_t>& GetHashes() const noexcept;
+    // CDC mode signature of BASIS file, chunk boundaries depend on preceding content so it is always hashed serially
+    Signature(std::string_view fileName, const CdcParameters& parameters, ThreadPool* pool = nullptr);
 
-    // save calculations + metadata to signature file
-    void Serialize(std::ostream& out) const;
+    // the same for data already in memory: BASIS content is hashed straight from the buffer, SIGNATURE is a serialized
+    // signature (file content); the signature does not refer to data after construction
+    Signature(std::span<const std::byte> data, InputFileType fileType, ChunkingMode mode = ChunkingMode::LINE, uint32_t chunkLength = 1,
+        ThreadPool* pool = nullptr, bool strongHashes = false);
+    Signature(std::span<const std::byte> data, const CdcParameters& parameters, ThreadPool* pool = nullptr);
+
+    // updated signature of BASIS file whose first unchangedLength bytes are the same as in the file previous signature
+    // was calculated for (its whole old size for append-only file); hashes of chunks lying within them are taken from
+    // previous and only the rest is hashed (CDC boundaries are still found by scanning, just not rehashed); chunking
+    // parameters and strong hashes follow previous; the last reused chunk is checked against the file
+    Signature(std::string_view fileName, const Signature& previous, uint64_t unchangedLength, ThreadPool* pool = nullptr);
+
+    // hashes may point into the mapped signature file, copying would leave them dangling
+    Signature(const Signature&) = delete;
+    Signature& operator=(const Signature&) = delete;
+    Signature(Signature&&) = default;
+    Signature& operator=(Signature&&) = default;
+
+    std::span<const uint32_t> GetHashes() const noexcept;
+
+    // strong hashes confirming weak hash matches, one per chunk in BLOCK mode and in LINE mode if requested, empty otherwise
+    std::span<const uint64_t> GetStrongHashes() const noexcept;
 
-protected:
     const Metadata& GetMetadata() const noexcept;
 
+    // adds Merkle-style hash tree to BLOCK mode signature: a node of level 1 is TreeNodeHash() of strong hashes of up to
+    // fanout consecutive blocks, a node of every higher level the same over nodes below it, up to a single root; delta
+    // then confirms a whole run of unchanged blocks by comparing one node
+    void AddTree(uint32_t fanout);
+
+    // number of hash tree levels above strong hashes, 0 without tree
+    size_t GetTreeHeight() const noexcept;
+
+    // nodes of given hash tree level, level 0 being strong hashes; empty above the root
+    std::span<const uint64_t> GetTreeLevel(size_t level) const noexcept;
+
+    // save calculations + metadata to signature file
+    void Serialize(std::ostream& out) const;
+
 private:
-    std::deque<uint32_t> m_hashes;
+    // path names the signature in error messages
+    void Load(std::string_view data, std::string_view path);
+    void LoadLegacy(std::string_view data, std::string_view path);
+    void Calculate(std::string_view path, ThreadPool* pool, bool strongHashes);
+    void CalculateInMemory(std::string_view data, ThreadPool* pool, bool strongHashes);
+    // sets file size and number of chunks once all hashes are calculated
+    void Finish(uint64_t fileSize);
+    void CalculatePartitions(std::string_view data, ThreadPool* pool, bool strongHashes);
+    // hashes chunks of data which cannot go on in data following it, returns their length
+    size_t CalculateComplete(std::string_view data, ThreadPool* pool, bool strongHashes);
+    void Update(std::string_view path, const Signature& previous, uint64_t unchangedLength, ThreadPool* pool);
+
+    std::optional<InputFile> m_file; // loaded signature file, hash views may point into it
+    std::vector<uint32_t> m_hashes; // owned hashes, used when they cannot be taken from m_file in place
+    std::vector<uint64_t> m_strongHashes;
+    std::vector<uint64_t> m_tree; // nodes of all levels, lowest one first
+    std::span<const uint32_t> m_hashView;
+    std::span<const uint64_t> m_strongHashView;
+    std::span<const uint64_t> m_treeView;
     Metadata m_metadata;
 };
 
+// hash of a tree node over its children (strong hashes or nodes of the level below), XXH64 of them as stored in
+// signature file
+uint64_t TreeNodeHash(std::span<const uint64_t> children);
+
 } // filediff
 #endif // SIGNATURE_H
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include "signaturecache.h"
+#include "stats.h"
+
+namespace {
+
+constexpr std::string_view ENTRY_EXTENSION { ".sig" };
+
+// identity of file content as seen by the filesystem together with chunking parameters, nothing for files which are
+// not regular ones (pipes have no stable identity)
+std::optional<std::string> EntryName(std::string_view fileName, const filediff::SignatureCache::Parameters& parameters)
+{
+    struct stat status;
+    if (::stat(std::string { fileName }.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+        return std::nullopt;
+    }
+    const auto modificationTime { static_cast<uint64_t>(status.st_mtim.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(status.st_mtim.tv_nsec) };
+    return fmt::format("{:x}-{:x}-{:x}-{:x}.{}-{}-{}-{}-{}-{}{}", static_cast<uint64_t>(status.st_dev), static_cast<uint64_t>(status.st_ino),
+        static_cast<uint64_t>(status.st_size), modificationTime, static_cast<uint32_t>(parameters.m_mode), parameters.m_chunkLength,
+        parameters.m_minChunkLength, parameters.m_maxChunkLength, parameters.m_strongHashes ? 1 : 0, parameters.m_treeFanout, ENTRY_EXTENSION);
+}
+
+bool Matches(const filediff::Signature& signature, const filediff::SignatureCache::Parameters& parameters)
+{
+    const auto& metadata { signature.GetMetadata() };
+    const auto strongHashes { parameters.m_strongHashes || parameters.m_mode != filediff::Signature::ChunkingMode::LINE };
+    return metadata.m_mode == parameters.m_mode && metadata.m_chunkLenght == parameters.m_chunkLength
+        && metadata.m_minChunkLength == parameters.m_minChunkLength && metadata.m_maxChunkLength == parameters.m_maxChunkLength
+        && metadata.m_treeFanout == parameters.m_treeFanout
+        && metadata.m_strongHashes == strongHashes;
+}
+
+} // namespace
+
+filediff::SignatureCache::SignatureCache(std::string_view directory, uint64_t sizeLimit)
+    : m_directory { directory }
+    , m_sizeLimit { sizeLimit }
+{
+    std::filesystem::create_directories(m_directory);
+}
+
+filediff::Signature filediff::SignatureCache::GetOrCalculate(std::string_view fileName, const Parameters& parameters,
+    const std::function<Signature()>& calculate)
+{
+    const auto entryName { EntryName(fileName, parameters) };
+    if (!entryName) {
+        return calculate();
+    }
+
+    const auto entryPath { (std::filesystem::path { m_directory } / *entryName).string() };
+    std::error_code error;
+    if (std::filesystem::exists(entryPath, error)) {
+        try {
+            FILEDIFF_STATS_PHASE("signature cache lookup");
+            Signature cached { entryPath, Signature::InputFileType::SIGNATURE };
+            if (Matches(cached, parameters)) {
+                std::filesystem::last_write_time(entryPath, std::filesystem::file_time_type::clock::now(), error);
+                return cached;
+            }
+        } catch (const std::runtime_error&) {
+            // damaged entry is replaced below
+        }
+        std::filesystem::remove(entryPath, error);
+    }
+
+    auto signature { calculate() };
+    // file changed while it was hashed, the signature may not match any state of it worth caching
+    if (EntryName(fileName, parameters) == entryName) {
+        // cache is an optimization only, failing to store an entry must not fail the signature itself
+        try {
+            Store(entryPath, signature);
+            Evict();
+        } catch (const std::exception&) {
+        }
+    }
+    return signature;
+}
+
+void filediff::SignatureCache::Store(const std::string& entryPath, const Signature& signature) const
+{
+    // temporary name is unique per process, concurrent writers of the same entry both rename a complete file
+    const auto tmpPath { fmt::format("{}.{}.tmp", entryPath, ::getpid()) };
+    try {
+        {
+            std::ofstream out { tmpPath, std::ios::binary };
+            signature.Serialize(out);
+            out.flush();
+            if (!out) {
+                throw std::runtime_error(fmt::format("Cannot write cache entry {}!", tmpPath));
+            }
+        }
+        std::filesystem::rename(tmpPath, entryPath);
+    } catch (...) {
+        std::error_code error;
+        std::filesystem::remove(tmpPath, error);
+        throw;
+    }
+}
+
+void filediff::SignatureCache::Evict() const
+{
+    std::vector<std::tuple<std::filesystem::file_time_type, uint64_t, std::filesystem::path>> entries;
+    uint64_t totalSize { 0 };
+    for (const auto& entry : std::filesystem::directory_iterator { m_directory }) {
+        std::error_code error;
+        if (entry.path().extension() != ENTRY_EXTENSION || !entry.is_regular_file(error)) {
+            continue;
+        }
+        const auto size { entry.file_size(error) };
+        const auto time { entry.last_write_time(error) };
+        if (error) {
+            continue; // removed by another process in the meantime
+        }
+        entries.emplace_back(time, size, entry.path());
+        totalSize += size;
+    }
+
+    std::sort(entries.begin(), entries.end());
+    for (const auto& [time, size, path] : entries) {
+        if (totalSize <= m_sizeLimit) {
+            break;
+        }
+        std::error_code error;
+        std::filesystem::remove(path, error);
+        totalSize -= size;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef SIGNATURECACHE_H
+#define SIGNATURECACHE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "signature.h"
+
+namespace filediff {
+
+// On-disk cache of BASIS file signatures, one signature file per entry. Entry name is made of device, inode, size and
+// modification time of the file together with chunking parameters, so any change of the file or of the parameters
+// leads to another entry. Entries are written to a temporary file and renamed, readers never see partial ones.
+// Modification time of an entry is refreshed on every hit and the least recently used entries are removed when total
+// size of the cache exceeds its limit.
+class SignatureCache
+{
+public:
+    struct Parameters {
+        Signature::ChunkingMode m_mode { Signature::ChunkingMode::LINE };
+        uint32_t m_chunkLength { 1 };
+        uint32_t m_minChunkLength { 0 }; // CDC mode only
+        uint32_t m_maxChunkLength { 0 }; // CDC mode only
+        bool m_strongHashes { false }; // LINE mode only, other modes always have them
+        uint32_t m_treeFanout { 0 }; // BLOCK mode only, 0 without hash tree
+    };
+
+    // directory is created if it does not exist
+    SignatureCache(std::string_view directory, uint64_t sizeLimit);
+
+    // signature of given file taken from cache, or calculated by 'calculate' and stored unless the file changed
+    // in the meantime; damaged entries are dropped and calculated again
+    Signature GetOrCalculate(std::string_view fileName, const Parameters& parameters, const std::function<Signature()>& calculate);
+
+private:
+    void Store(const std::string& entryName, const Signature& signature) const;
+    void Evict() const;
+
+    std::string m_directory;
+    uint64_t m_sizeLimit;
+};
+
+} // filediff
+#endif // SIGNATURECACHE_H
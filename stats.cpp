@@ -0,0 +1,85 @@
+#include <algorithm>
+
+#include <fmt/core.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+
+namespace {
+
+constexpr std::array<std::string_view, static_cast<size_t>(filediff::Stats::Counter::COUNT)> COUNTER_NAMES {
+    "bytes_read", "chunks_hashed", "hash_lookups", "collisions", "copies", "literals", "literal_bytes", "removed",
+    "tree_confirmed_blocks"
+};
+
+uint64_t PeakRssKiB()
+{
+    struct rusage usage { };
+    return ::getrusage(RUSAGE_SELF, &usage) == 0 ? static_cast<uint64_t>(usage.ru_maxrss) : 0;
+}
+
+} // namespace
+
+filediff::Stats& filediff::Stats::Instance()
+{
+    static Stats stats;
+    return stats;
+}
+
+uint64_t filediff::Stats::Get(Counter counter) const noexcept
+{
+    return m_counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+}
+
+void filediff::Stats::AddPhase(std::string_view name, std::chrono::nanoseconds elapsed)
+{
+    const std::lock_guard lock { m_mutex };
+    const auto it { std::find_if(std::begin(m_phases), std::end(m_phases), [name](const auto& phase) { return phase.first == name; }) };
+    if (it == std::end(m_phases)) {
+        m_phases.emplace_back(name, elapsed);
+    } else {
+        it->second += elapsed;
+    }
+}
+
+std::vector<std::pair<std::string_view, std::chrono::nanoseconds>> filediff::Stats::GetPhases() const
+{
+    const std::lock_guard lock { m_mutex };
+    return m_phases;
+}
+
+void filediff::Stats::Reset()
+{
+    for (auto& counter : m_counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    const std::lock_guard lock { m_mutex };
+    m_phases.clear();
+}
+
+void filediff::Stats::Print(std::ostream& out, Format format) const
+{
+    const auto phases { GetPhases() };
+    auto milliseconds = [](std::chrono::nanoseconds elapsed) { return std::chrono::duration<double, std::milli>(elapsed).count(); };
+
+    if (format == Format::JSON) {
+        out << "{\"phases_ms\":{";
+        for (size_t i { 0 }; i < phases.size(); ++i) {
+            out << fmt::format("{}\"{}\":{:.3f}", i ? "," : "", phases[i].first, milliseconds(phases[i].second));
+        }
+        out << "},\"counters\":{";
+        for (size_t i { 0 }; i < COUNTER_NAMES.size(); ++i) {
+            out << fmt::format("{}\"{}\":{}", i ? "," : "", COUNTER_NAMES[i], m_counters[i].load(std::memory_order_relaxed));
+        }
+        out << fmt::format("}},\"peak_rss_kib\":{}}}\n", PeakRssKiB());
+        return;
+    }
+
+    for (const auto& [name, elapsed] : phases) {
+        out << fmt::format("{:<24}{:>14.3f} ms\n", name, milliseconds(elapsed));
+    }
+    for (size_t i { 0 }; i < COUNTER_NAMES.size(); ++i) {
+        out << fmt::format("{:<24}{:>14}\n", COUNTER_NAMES[i], m_counters[i].load(std::memory_order_relaxed));
+    }
+    out << fmt::format("{:<24}{:>14} KiB\n", "peak_rss", PeakRssKiB());
+}
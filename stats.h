@@ -0,0 +1,101 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace filediff {
+
+// Process wide phase timers and counters reported by --stats. Counters are relaxed atomics so workers of a pool may
+// add to them, hot loops are expected to count locally and add once per partition or run.
+class Stats
+{
+public:
+    enum class Counter {
+        BYTES_READ, // input files (basis, data file, signature, delta)
+        CHUNKS_HASHED, // lines or blocks hashed while calculating signature or parsing data file
+        HASH_LOOKUPS, // hash index queries while matching
+        COLLISIONS, // weak hash matched but strong hash did not
+        COPIES, // COPY instructions emitted
+        LITERALS, // LITERAL instructions emitted
+        LITERAL_BYTES,
+        REMOVED, // REMOVED instructions emitted
+        TREE_CONFIRMED_BLOCKS, // blocks matched through hash tree nodes instead of being scanned
+        COUNT
+    };
+
+    enum class Format {
+        TEXT,
+        JSON
+    };
+
+    static Stats& Instance();
+
+    void Add(Counter counter, uint64_t value) noexcept
+    {
+        m_counters[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint64_t Get(Counter counter) const noexcept;
+
+    // time spent in a phase of given name is summed over all its scopes, phases are reported in order of appearance
+    void AddPhase(std::string_view name, std::chrono::nanoseconds elapsed);
+
+    std::vector<std::pair<std::string_view, std::chrono::nanoseconds>> GetPhases() const;
+
+    void Reset();
+
+    void Print(std::ostream& out, Format format) const;
+
+private:
+    Stats() = default;
+
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::COUNT)> m_counters {};
+    mutable std::mutex m_mutex;
+    std::vector<std::pair<std::string_view, std::chrono::nanoseconds>> m_phases; // names are string literals
+};
+
+// measures the scope it lives in as a phase of Stats
+class ScopedPhase
+{
+public:
+    explicit ScopedPhase(std::string_view name) noexcept
+        : m_name { name }
+        , m_start { std::chrono::steady_clock::now() }
+    {
+    }
+
+    ~ScopedPhase()
+    {
+        Stats::Instance().AddPhase(m_name, std::chrono::steady_clock::now() - m_start);
+    }
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private:
+    std::string_view m_name;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+} // filediff
+
+// instrumentation compiles to nothing unless FILEDIFF_STATS is defined (CMake option of the same name)
+#ifdef FILEDIFF_STATS
+#define FILEDIFF_STATS_CONCAT_(a, b) a##b
+#define FILEDIFF_STATS_CONCAT(a, b) FILEDIFF_STATS_CONCAT_(a, b)
+#define FILEDIFF_STATS_PHASE(name) const filediff::ScopedPhase FILEDIFF_STATS_CONCAT(statsPhase, __LINE__) { name }
+#define FILEDIFF_STATS_ADD(counter, value) filediff::Stats::Instance().Add(filediff::Stats::Counter::counter, (value))
+#else
+#define FILEDIFF_STATS_PHASE(name) static_cast<void>(0)
+#define FILEDIFF_STATS_ADD(counter, value) static_cast<void>(sizeof(value))
+#endif
+
+#endif // STATS_H
@@ -0,0 +1,74 @@
+// capi.h compiled as C, the way callers of the C interface see it; exits with nonzero status on the first failed check
+
+#include <stdio.h>
+#include <string.h>
+
+#include "capi.h"
+
+#define CHECK(condition)                                                                     \
+    do {                                                                                     \
+        if (!(condition)) {                                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s (%s)\n", __FILE__, __LINE__, #condition, \
+                filediff_last_error());                                                      \
+            return 1;                                                                        \
+        }                                                                                    \
+    } while (0)
+
+struct Output {
+    char data[256];
+    size_t size;
+};
+
+static int Append(void* context, const void* data, size_t size)
+{
+    struct Output* output = (struct Output*)context;
+    if (output->size + size > sizeof(output->data)) {
+        return 1;
+    }
+    memcpy(output->data + output->size, data, size);
+    output->size += size;
+    return 0;
+}
+
+static int CountCopies(void* context, const filediff_instruction* instruction)
+{
+    if (instruction->type == FILEDIFF_INSTRUCTION_COPY) {
+        ++*(int*)context;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const char base[] = "aaa\nbbb\nccc\n";
+    static const char updated[] = "aaa\nxxx\nccc\n";
+    filediff_signature_options signatureOptions = { 0 };
+    filediff_delta_options deltaOptions = { 0 };
+    filediff_signature* signature = NULL;
+    filediff_signature* loaded = NULL;
+    struct Output serialized = { { 0 }, 0 };
+    struct Output delta = { { 0 }, 0 };
+    int copies = 0;
+
+    CHECK(filediff_abi_version() == FILEDIFF_ABI_VERSION);
+
+    signatureOptions.chunking = FILEDIFF_CHUNKING_LINE;
+    signatureOptions.strong_hashes = 1;
+    CHECK(filediff_signature_calculate(base, strlen(base), &signatureOptions, &signature) == FILEDIFF_OK);
+    CHECK(filediff_signature_serialize(signature, Append, &serialized) == FILEDIFF_OK);
+    CHECK(filediff_signature_load(serialized.data, serialized.size, &loaded) == FILEDIFF_OK);
+
+    deltaOptions.format = FILEDIFF_FORMAT_TEXT;
+    CHECK(filediff_delta(loaded, updated, strlen(updated), &deltaOptions, Append, &delta) == FILEDIFF_OK);
+    CHECK(delta.size != 0 && memchr(delta.data, 'x', delta.size) != NULL);
+    CHECK(filediff_delta_instructions(loaded, updated, strlen(updated), NULL, CountCopies, &copies) == FILEDIFF_OK);
+    CHECK(copies == 2);
+
+    // failures come back as status with a reason
+    CHECK(filediff_signature_calculate(base, strlen(base), NULL, NULL) == FILEDIFF_INVALID_ARGUMENT);
+    CHECK(strlen(filediff_last_error()) != 0);
+
+    filediff_signature_free(loaded);
+    filediff_signature_free(signature);
+    return 0;
+}
@@ -0,0 +1,31 @@
+// every header installed as public API (see install(FILES) in CMakeLists.txt) is included twice, so the build breaks
+// when one of them lacks include guard or does not compile on its own
+
+#include "adler32.h"
+#include "adler32.h"
+#include "batch.h"
+#include "batch.h"
+#include "capi.h"
+#include "capi.h"
+#include "cdc.h"
+#include "cdc.h"
+#include "codec.h"
+#include "codec.h"
+#include "delta.h"
+#include "delta.h"
+#include "deltaformat.h"
+#include "deltaformat.h"
+#include "inputfile.h"
+#include "inputfile.h"
+#include "patch.h"
+#include "patch.h"
+#include "readpipeline.h"
+#include "readpipeline.h"
+#include "signature.h"
+#include "signature.h"
+#include "signaturecache.h"
+#include "signaturecache.h"
+#include "threadpool.h"
+#include "threadpool.h"
+#include "xxhash64.h"
+#include "xxhash64.h"
@@ -1,14 +1,37 @@
+#include <algorithm>
 #include <array>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <random>
+#include <thread>
+#include <tuple>
 #include <utility>
 
 #include <fmt/core.h>
 #include <gtest/gtest.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "../adler32.h"
+#include "../alignment.h"
+#include "../batch.h"
+#include "../capi.h"
+#include "../cdc.h"
+#include "../codec.h"
 #include "../delta.h"
+#include "../deltaformat.h"
+#include "../hashindex.h"
+#include "../inputfile.h"
+#include "../patch.h"
+#include "../readpipeline.h"
 #include "../signature.h"
+#include "../signaturecache.h"
+#include "../stats.h"
+#include "../threadpool.h"
+#include "../xxhash64.h"
 
 namespace testing {
 
@@ -27,18 +50,313 @@ class adler32TestSuite : public ::testing::Test {
 
 TEST(adler32TestSuite, OneWordTest)
 {
-    ASSERT_EQ(WIKIPEDIA_HASH, adler32(WIKIPEDIA_STR));
+    ASSERT_EQ(WIKIPEDIA_HASH, filediff::adler32(WIKIPEDIA_STR));
 }
 
 TEST(adler32TestSuite, LoremIpsumTest)
 {
-    ASSERT_EQ(LOREM_IPSUM_HASH, adler32(LOREM_IPSUM_STR));
+    ASSERT_EQ(LOREM_IPSUM_HASH, filediff::adler32(LOREM_IPSUM_STR));
+}
+
+class adler32KernelTestSuite : public ::testing::TestWithParam<filediff::Adler32Kernel> {
+};
+
+TEST_P(adler32KernelTestSuite, ReferenceVectorsTest)
+{
+    if (!filediff::adler32KernelSupported(GetParam())) {
+        GTEST_SKIP() << "kernel not supported by this CPU";
+    }
+
+    EXPECT_EQ(WIKIPEDIA_HASH, filediff::adler32(WIKIPEDIA_STR, GetParam()));
+    EXPECT_EQ(LOREM_IPSUM_HASH, filediff::adler32(LOREM_IPSUM_STR, GetParam()));
+    EXPECT_EQ(1U, filediff::adler32("", GetParam()));
+
+    // long inputs of high bytes used to overflow, reference values come from zlib
+    EXPECT_EQ(0xB623EB2BU, filediff::adler32(std::string(10000, '\xFF'), GetParam()));
+    std::string data(100000, '\0');
+    for (auto i { 0U }; i < data.size(); ++i) {
+        data[i] = static_cast<char>((i * 7 + i / 256) % 256);
+    }
+    EXPECT_EQ(0xD43B9AEFU, filediff::adler32(data, GetParam()));
+
+    // every tail length and misaligned start has to give the same result as scalar kernel
+    const std::string_view view { data };
+    for (auto length { 0U }; length < 100; ++length) {
+        ASSERT_EQ(filediff::adler32(view.substr(3, 6000 + length), filediff::Adler32Kernel::SCALAR), filediff::adler32(view.substr(3, 6000 + length), GetParam()));
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(adler32Kernels, adler32KernelTestSuite,
+    ::testing::Values(filediff::Adler32Kernel::SCALAR, filediff::Adler32Kernel::SSE41, filediff::Adler32Kernel::AVX2));
+
+TEST(adler32TestSuite, RollingMatchesRecalculationTest)
+{
+    const std::string_view text { LOREM_IPSUM_STR };
+    constexpr auto WINDOW_SIZE { 16U };
+
+    filediff::RollingAdler32 rolling { text.substr(0, WINDOW_SIZE) };
+    EXPECT_EQ(filediff::adler32(text.substr(0, WINDOW_SIZE)), rolling.Digest());
+    for (auto i { 0U }; i + WINDOW_SIZE < text.size(); ++i) {
+        rolling.Roll(text[i], text[i + WINDOW_SIZE]);
+        ASSERT_EQ(filediff::RollingAdler32 { text.substr(i + 1, WINDOW_SIZE) }.Digest(), rolling.Digest());
+    }
+    EXPECT_EQ(WIKIPEDIA_HASH, filediff::RollingAdler32 { WIKIPEDIA_STR }.Digest());
+}
+
+class xxhash64TestSuite : public ::testing::Test {
+};
+
+TEST(xxhash64TestSuite, ReferenceVectorsTest)
+{
+    EXPECT_EQ(0xEF46DB3751D8E999ULL, filediff::xxhash64(""));
+    EXPECT_EQ(0x44BC2CF5AD770999ULL, filediff::xxhash64("abc"));
+    EXPECT_NE(filediff::xxhash64(LOREM_IPSUM_STR), filediff::xxhash64(std::string_view { LOREM_IPSUM_STR }.substr(1)));
+}
+
+class HashIndexTestSuite : public ::testing::Test {
+};
+
+TEST(HashIndexTestSuite, PositionsOfRepeatingHashesTest)
+{
+    const std::vector<uint32_t> hashes { WIKIPEDIA_HASH, LOREM_IPSUM_HASH, WIKIPEDIA_HASH, SOME_TEXT_HASH, WIKIPEDIA_HASH };
+    const filediff::HashIndex index { hashes };
+
+    const auto positions { index.Find(WIKIPEDIA_HASH) };
+    ASSERT_EQ(3, positions.size());
+    EXPECT_EQ(0, positions[0]);
+    EXPECT_EQ(2, positions[1]);
+    EXPECT_EQ(4, positions[2]);
+
+    EXPECT_EQ(2, index.FindFrom(WIKIPEDIA_HASH, 1));
+    EXPECT_EQ(4, index.FindFrom(WIKIPEDIA_HASH, 3));
+    EXPECT_EQ(filediff::HashIndex::NPOS, index.FindFrom(WIKIPEDIA_HASH, 5));
+    EXPECT_EQ(filediff::HashIndex::NPOS, index.FindFrom(LOREM_IPSUM_HASH, 2));
+    EXPECT_FALSE(index.Contains(YET_ANOTHER_TEXT_HASH));
+    EXPECT_TRUE(index.Find(YET_ANOTHER_TEXT_HASH).empty());
+}
+
+class AlignmentTestSuite : public ::testing::Test {
+};
+
+TEST(AlignmentTestSuite, LongestRunOfUniqueChunksIsKeptTest)
+{
+    const std::vector<uint32_t> oldHashes { 1, 2, 3, 4, 5, 6, 7 };
+    const std::vector<uint32_t> newHashes { 6, 2, 3, 9, 4, 1, 5, 7 };
+    const auto aligned { filediff::PatienceAlign(oldHashes, newHashes, [](size_t, size_t) { return true; }) };
+    const std::vector<std::pair<size_t, size_t>> EXPECTED_ALIGNMENT { { 1, 1 }, { 2, 2 }, { 3, 4 }, { 4, 6 }, { 6, 7 } };
+    EXPECT_EQ(EXPECTED_ALIGNMENT, aligned);
+}
+
+TEST(AlignmentTestSuite, RepeatingChunksAreAnchoredOnRarestTest)
+{
+    const std::vector<uint32_t> oldHashes { 1, 1, 2, 1, 2, 3 };
+    const std::vector<uint32_t> newHashes { 2, 1, 2, 1, 1 };
+    // chunk 2 at old position 2 is rejected as if it was a weak hash collision //
+    const auto aligned { filediff::PatienceAlign(oldHashes, newHashes, [](size_t oldPosition, size_t) { return oldPosition != 2; }) };
+    ASSERT_FALSE(aligned.empty());
+    for (auto i { 1U }; i < aligned.size(); ++i) {
+        EXPECT_LT(aligned[i - 1].first, aligned[i].first);
+        EXPECT_LT(aligned[i - 1].second, aligned[i].second);
+    }
+    for (const auto& [oldPosition, newPosition] : aligned) {
+        EXPECT_EQ(oldHashes[oldPosition], newHashes[newPosition]);
+        EXPECT_NE(2U, oldPosition);
+    }
+    EXPECT_EQ(3U, aligned.size());
+}
+
+class CodecTestSuite : public ::testing::TestWithParam<filediff::CodecType> {
+};
+
+TEST_P(CodecTestSuite, BlocksRoundTripTest)
+{
+    if (!filediff::IsCodecAvailable(GetParam())) {
+        GTEST_SKIP() << filediff::CodecName(GetParam()) << " is not built in";
+    }
+    const auto codec { filediff::MakeCodec(GetParam()) };
+    ASSERT_EQ(GetParam(), codec->Type());
+
+    std::string data;
+    for (auto i { 0U }; i < 10000; ++i) {
+        data += fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 61), i);
+    }
+    // contexts are reused, every block has to come out on its own //
+    for (const auto block : { std::string_view { data }, std::string_view { WIKIPEDIA_STR }, std::string_view {} }) {
+        std::string compressed { "prefix" };
+        codec->Compress(block, compressed);
+        ASSERT_TRUE(compressed.starts_with("prefix"));
+        std::string decompressed;
+        codec->Decompress(std::string_view { compressed }.substr(6), block.size(), decompressed);
+        EXPECT_EQ(block, decompressed);
+    }
+
+    std::string compressed;
+    codec->Compress(data, compressed);
+    EXPECT_LT(compressed.size() * 4, data.size());
+    std::string decompressed;
+    EXPECT_ANY_THROW(codec->Decompress(compressed, data.size() + 1, decompressed));
+    EXPECT_ANY_THROW(codec->Decompress(std::string_view { compressed }.substr(0, compressed.size() / 2), data.size(), decompressed));
+    EXPECT_THROW(filediff::MakeCodec(GetParam(), 1000), std::invalid_argument);
+}
+
+INSTANTIATE_TEST_SUITE_P(Codecs, CodecTestSuite,
+    ::testing::Values(filediff::CodecType::ZLIB, filediff::CodecType::ZSTD, filediff::CodecType::LZ4));
+
+class InputFileTestSuite : public ::testing::Test {
+};
+
+TEST(InputFileTestSuite, RegularFileIsMappedTest)
+{
+    const std::string testFile { "test.txt" };
+    std::ofstream ofs { testFile };
+    ofs << WIKIPEDIA_STR << "\n"
+        << LOREM_IPSUM_STR;
+    ofs.close();
+
+    const filediff::InputFile input { testFile };
+    EXPECT_TRUE(input.IsMapped());
+    EXPECT_EQ(fmt::format("{}\n{}", WIKIPEDIA_STR, LOREM_IPSUM_STR), input.Data());
+
+    filediff::ChunkReader reader { input.Data() };
+    EXPECT_EQ(WIKIPEDIA_STR, reader.NextLine());
+    EXPECT_EQ(std::string_view { WIKIPEDIA_STR }.size() + 1, reader.Position());
+    EXPECT_EQ(LOREM_IPSUM_STR, reader.NextLine());
+    EXPECT_FALSE(reader.NextLine());
+}
+
+TEST(InputFileTestSuite, PipeIsReadIntoBufferTest)
+{
+    const std::string fifo { "test.fifo" };
+    std::remove(fifo.c_str());
+    ASSERT_EQ(0, ::mkfifo(fifo.c_str(), 0600));
+
+    std::thread writer { [&fifo] {
+        std::ofstream ofs { fifo };
+        ofs << LOREM_IPSUM_STR;
+    } };
+    const filediff::InputFile input { fifo };
+    writer.join();
+    std::remove(fifo.c_str());
+
+    EXPECT_FALSE(input.IsMapped());
+    EXPECT_EQ(LOREM_IPSUM_STR, input.Data());
+
+    filediff::ChunkReader reader { input.Data() };
+    EXPECT_EQ(std::string_view { LOREM_IPSUM_STR }.substr(0, 100), reader.NextBlock(100));
+    EXPECT_EQ(100, reader.Position());
+}
+
+// written file is flushed and dropped from page cache, so that it is read as a cold one
+void EvictFromPageCache(const std::string& path)
+{
+    const auto fd { ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+    ASSERT_LE(0, fd);
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+}
+
+class ReadPipelineTestSuite : public ::testing::TestWithParam<filediff::ReadPipeline::Backend> {
+};
+
+TEST_P(ReadPipelineTestSuite, PiecesComeInFileOrderTest)
+{
+    // small buffers so that the ring wraps around several times, sizes around multiples of buffer size
+    constexpr size_t BUFFER_SIZE { 4096 };
+    const std::string testFile { "test.txt" };
+    for (const auto size : { size_t { 0 }, size_t { 1 }, BUFFER_SIZE - 1, BUFFER_SIZE, BUFFER_SIZE + 1, 11 * BUFFER_SIZE + 17 }) {
+        std::string content;
+        for (size_t i { 0 }; content.size() < size; ++i) {
+            content += fmt::format("{} ", i);
+        }
+        content.resize(size);
+        {
+            std::ofstream ofs { testFile, std::ios::binary };
+            ofs << content;
+        }
+
+        filediff::ReadPipeline reader { testFile, GetParam(), BUFFER_SIZE, 3 };
+        std::string read;
+        for (auto piece { reader.Next() }; !piece.empty(); piece = reader.Next()) {
+            EXPECT_TRUE(piece.size() == BUFFER_SIZE || read.size() + piece.size() == size) << size;
+            EXPECT_EQ(0, reinterpret_cast<uintptr_t>(piece.data()) % filediff::READ_BUFFER_ALIGNMENT);
+            read += piece;
+        }
+        EXPECT_EQ(content, read);
+        EXPECT_TRUE(reader.Next().empty());
+    }
+}
+
+TEST_P(ReadPipelineTestSuite, PipeIsReadInOrderTest)
+{
+    const std::string fifo { "test.fifo" };
+    std::remove(fifo.c_str());
+    ASSERT_EQ(0, ::mkfifo(fifo.c_str(), 0600));
+    std::string content;
+    for (auto i { 0U }; i < 10000; ++i) {
+        content += fmt::format("{}\n", i);
+    }
+
+    std::thread writer { [&fifo, &content] {
+        std::ofstream ofs { fifo };
+        ofs << content;
+    } };
+    std::string read;
+    {
+        filediff::ReadPipeline reader { fifo, GetParam(), 1000, 2 };
+        EXPECT_FALSE(reader.UsesIoUring());
+        for (auto piece { reader.Next() }; !piece.empty(); piece = reader.Next()) {
+            read += piece;
+        }
+    }
+    writer.join();
+    std::remove(fifo.c_str());
+    EXPECT_EQ(content, read);
+}
+
+INSTANTIATE_TEST_SUITE_P(ReadPipelineBackends, ReadPipelineTestSuite,
+    ::testing::Values(filediff::ReadPipeline::Backend::AUTO, filediff::ReadPipeline::Backend::THREAD));
+
+TEST(InputFileTestSuite, ProcessedWhileReadTest)
+{
+    const std::string testFile { "test.txt" };
+    std::string content;
+    while (content.size() < 3 * filediff::ReadPipeline::DEFAULT_BUFFER_SIZE) {
+        content += LOREM_IPSUM_STR;
+    }
+    {
+        std::ofstream ofs { testFile, std::ios::binary };
+        ofs << content;
+    }
+
+    std::vector<size_t> readSizes;
+    auto onRead = [&](std::string_view data) {
+        EXPECT_EQ(std::string_view { content }.substr(0, data.size()), data);
+        readSizes.push_back(data.size());
+    };
+    {
+        // just written file is in page cache, nothing to overlap
+        const filediff::InputFile input { testFile, onRead };
+        EXPECT_TRUE(input.IsMapped());
+        EXPECT_EQ(content, input.Data());
+        EXPECT_EQ(1, readSizes.size());
+    }
+
+    readSizes.clear();
+    EvictFromPageCache(testFile);
+    const filediff::InputFile input { testFile, onRead };
+    EXPECT_TRUE(input.IsMapped());
+    EXPECT_EQ(content, input.Data());
+    // handed out window by window unless filesystem keeps the pages (tmpfs)
+    EXPECT_TRUE(readSizes.size() == 1 || readSizes.size() == 4);
+    EXPECT_TRUE(std::ranges::is_sorted(readSizes));
 }
 
 class SignatureTesting : public filediff::Signature {
 public:
-    SignatureTesting(std::string_view fileName, InputFileType fileType)
-        : Signature(fileName, fileType)
+    SignatureTesting(std::string_view fileName, InputFileType fileType, ChunkingMode mode = ChunkingMode::LINE, uint32_t chunkLength = 1,
+        filediff::ThreadPool* pool = nullptr, bool strongHashes = false)
+        : Signature(fileName, fileType, mode, chunkLength, pool, strongHashes)
     {
     }
 
@@ -86,14 +404,457 @@ TEST(SignatureBasicTestSuite, SerializeTest)
     SignatureTesting signature { testFile, filediff::Signature::InputFileType::BASIS };
     std::stringstream ss;
     signature.Serialize(ss);
-    ss.seekp(0);
-    filediff::Signature::Metadata metadata;
-    ss.read(reinterpret_cast<char*>(&metadata), sizeof(decltype(metadata)));
-    uint32_t hash;
-    ss.read(reinterpret_cast<char*>(&hash), sizeof(uint32_t));
-    EXPECT_EQ(1, metadata.m_numberOfChunks);
-    EXPECT_EQ(1, metadata.m_chunkLenght);
-    EXPECT_EQ(LOREM_IPSUM_HASH, hash);
+    const auto serialized { ss.str() };
+    // fixed little-endian header followed by hashes at offset 64 //
+    auto readLittleEndian = [&serialized](size_t offset, size_t size) {
+        uint64_t value { 0 };
+        for (auto i { 0U }; i < size; ++i) {
+            value |= static_cast<uint64_t>(static_cast<unsigned char>(serialized[offset + i])) << (8 * i);
+        }
+        return value;
+    };
+    ASSERT_EQ(64 + sizeof(uint32_t), serialized.size());
+    EXPECT_EQ("FDSG", serialized.substr(0, 4));
+    EXPECT_EQ(filediff::SIGNATURE_VERSION, readLittleEndian(4, 4));
+    EXPECT_EQ(1, readLittleEndian(12, 4));
+    EXPECT_EQ(1, readLittleEndian(16, 8));
+    EXPECT_EQ(64, readLittleEndian(32, 8));
+    EXPECT_EQ(LOREM_IPSUM_HASH, readLittleEndian(64, 4));
+}
+
+TEST(SignatureBasicTestSuite, LoadedSignatureIsUsedInPlaceTest)
+{
+    const std::string testFile { "test.txt" };
+    std::ofstream ofs { testFile };
+    for (auto i { 0U }; i < 1000; ++i) {
+        ofs << WIKIPEDIA_STR << i << "\n";
+    }
+    ofs.close();
+
+    constexpr auto BLOCK_SIZE { 10U };
+    SignatureTesting signature { testFile, filediff::Signature::InputFileType::BASIS, filediff::Signature::ChunkingMode::BLOCK, BLOCK_SIZE };
+    const std::string sigFile { "test.txt.sig" };
+    {
+        std::ofstream ofSigStream { sigFile, std::ios::binary };
+        signature.Serialize(ofSigStream);
+    }
+
+    SignatureTesting loaded { sigFile, filediff::Signature::InputFileType::SIGNATURE };
+    EXPECT_TRUE(std::ranges::equal(signature.GetHashes(), loaded.GetHashes()));
+    EXPECT_TRUE(std::ranges::equal(signature.GetStrongHashes(), loaded.GetStrongHashes()));
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(loaded.GetHashes().data()) % alignof(uint32_t));
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(loaded.GetStrongHashes().data()) % alignof(uint64_t));
+}
+
+TEST(SignatureBasicTestSuite, CorruptedSignatureIsRejectedTest)
+{
+    const std::string testFile { "test.txt" };
+    std::ofstream ofs { testFile };
+    ofs << LOREM_IPSUM_STR << "\n" << WIKIPEDIA_STR;
+    ofs.close();
+
+    SignatureTesting signature { testFile, filediff::Signature::InputFileType::BASIS };
+    std::stringstream ss;
+    signature.Serialize(ss);
+    auto serialized { ss.str() };
+
+    const std::string sigFile { "test.txt.sig" };
+    auto writeAndLoad = [&sigFile](const std::string& content) {
+        {
+            std::ofstream ofSigStream { sigFile, std::ios::binary };
+            ofSigStream << content;
+        }
+        SignatureTesting loaded { sigFile, filediff::Signature::InputFileType::SIGNATURE };
+    };
+    EXPECT_NO_THROW(writeAndLoad(serialized));
+    EXPECT_THROW(writeAndLoad(serialized.substr(0, serialized.size() - 1)), std::runtime_error);
+    serialized.back() ^= 1;
+    EXPECT_THROW(writeAndLoad(serialized), std::runtime_error);
+}
+
+TEST(SignatureBasicTestSuite, LegacySignatureFileIsLoadedTest)
+{
+    // raw Metadata followed by hashes, as written before the versioned format //
+    struct {
+        size_t m_numberOfChunks;
+        uint32_t m_chunkLenght;
+        filediff::Signature::ChunkingMode m_mode;
+        uint64_t m_fileSize;
+    } const metadata { 2, 1, filediff::Signature::ChunkingMode::LINE, 0 };
+    const std::array<uint32_t, 2> hashes { WIKIPEDIA_HASH, LOREM_IPSUM_HASH };
+    const std::string sigFile { "test.txt.sig" };
+    {
+        std::ofstream ofSigStream { sigFile, std::ios::binary };
+        ofSigStream.write(reinterpret_cast<const char*>(&metadata), sizeof(metadata));
+        ofSigStream.write(reinterpret_cast<const char*>(hashes.data()), sizeof(hashes));
+    }
+
+    SignatureTesting loaded { sigFile, filediff::Signature::InputFileType::SIGNATURE };
+    EXPECT_EQ(2, loaded.GetMetadata().m_numberOfChunks);
+    EXPECT_TRUE(std::ranges::equal(hashes, loaded.GetHashes()));
+}
+
+TEST(SignatureBasicTestSuite, BaselineSignatureFileIsLoadedTest)
+{
+    // first signature files: Metadata of only number of chunks and chunk length (padded to 16 bytes) followed by
+    // host order line hashes //
+    struct {
+        size_t m_numberOfChunks;
+        uint32_t m_chunkLenght;
+    } const metadata { 3, 1 };
+    static_assert(sizeof(metadata) == 16);
+    const std::array<uint32_t, 3> hashes { WIKIPEDIA_HASH, LOREM_IPSUM_HASH, WIKIPEDIA_HASH };
+    const std::string sigFile { "test.txt.sig" };
+    {
+        std::ofstream ofSigStream { sigFile, std::ios::binary };
+        ofSigStream.write(reinterpret_cast<const char*>(&metadata), sizeof(metadata));
+        ofSigStream.write(reinterpret_cast<const char*>(hashes.data()), sizeof(hashes));
+    }
+
+    SignatureTesting loaded { sigFile, filediff::Signature::InputFileType::SIGNATURE };
+    EXPECT_EQ(filediff::Signature::ChunkingMode::LINE, loaded.GetMetadata().m_mode);
+    EXPECT_EQ(3, loaded.GetMetadata().m_numberOfChunks);
+    EXPECT_EQ(1, loaded.GetMetadata().m_chunkLenght);
+    EXPECT_EQ(0, loaded.GetMetadata().m_fileSize);
+    EXPECT_TRUE(std::ranges::equal(hashes, loaded.GetHashes()));
+    EXPECT_TRUE(loaded.GetStrongHashes().empty());
+}
+
+TEST(SignatureBasicTestSuite, UnversionedSignatureOfUnknownLayoutIsRejectedTest)
+{
+    // block mode metadata whose strong hashes are missing matches neither of the unversioned layouts //
+    struct {
+        size_t m_numberOfChunks;
+        uint32_t m_chunkLenght;
+        filediff::Signature::ChunkingMode m_mode;
+        uint64_t m_fileSize;
+    } const metadata { 2, 100, filediff::Signature::ChunkingMode::BLOCK, 200 };
+    const std::array<uint32_t, 2> hashes { WIKIPEDIA_HASH, LOREM_IPSUM_HASH };
+    const std::string sigFile { "test.txt.sig" };
+    {
+        std::ofstream ofSigStream { sigFile, std::ios::binary };
+        ofSigStream.write(reinterpret_cast<const char*>(&metadata), sizeof(metadata));
+        ofSigStream.write(reinterpret_cast<const char*>(hashes.data()), sizeof(hashes));
+    }
+
+    try {
+        SignatureTesting loaded { sigFile, filediff::Signature::InputFileType::SIGNATURE };
+        FAIL() << "signature of unknown layout was loaded";
+    } catch (const std::runtime_error& e) {
+        EXPECT_NE(std::string_view { e.what() }.find("no version header"), std::string_view::npos) << e.what();
+    }
+}
+
+TEST(SignatureBasicTestSuite, BlockModeSerializeTest)
+{
+    const std::string testFile { "test.txt" };
+    std::ofstream ofs { testFile };
+    ofs << LOREM_IPSUM_STR;
+    ofs.close();
+
+    constexpr auto BLOCK_SIZE { 100U };
+    const std::string_view text { LOREM_IPSUM_STR };
+    SignatureTesting signature { testFile, filediff::Signature::InputFileType::BASIS, filediff::Signature::ChunkingMode::BLOCK, BLOCK_SIZE };
+    const auto expectedBlocks { (text.size() + BLOCK_SIZE - 1) / BLOCK_SIZE };
+    ASSERT_EQ(expectedBlocks, signature.GetHashes().size());
+    ASSERT_EQ(expectedBlocks, signature.GetStrongHashes().size());
+    EXPECT_EQ(filediff::adler32(text.substr(0, BLOCK_SIZE)), signature.GetHashes()[0]);
+    EXPECT_EQ(filediff::xxhash64(text.substr((expectedBlocks - 1) * BLOCK_SIZE)), signature.GetStrongHashes().back());
+
+    const std::string sigFile { "test.txt.sig" };
+    std::ofstream ofSigStream { sigFile, std::ios::binary };
+    signature.Serialize(ofSigStream);
+    ofSigStream.close();
+
+    SignatureTesting loaded { sigFile, filediff::Signature::InputFileType::SIGNATURE };
+    EXPECT_EQ(filediff::Signature::ChunkingMode::BLOCK, loaded.GetMetadata().m_mode);
+    EXPECT_EQ(BLOCK_SIZE, loaded.GetMetadata().m_chunkLenght);
+    EXPECT_EQ(text.size(), loaded.GetMetadata().m_fileSize);
+    EXPECT_TRUE(std::ranges::equal(signature.GetHashes(), loaded.GetHashes()));
+    EXPECT_TRUE(std::ranges::equal(signature.GetStrongHashes(), loaded.GetStrongHashes()));
+}
+
+#ifdef FILEDIFF_STATS
+TEST(SignatureBasicTestSuite, StatsCountHashedChunksTest)
+{
+    const std::string testFile { "test.txt" };
+    std::ofstream ofs { testFile };
+    ofs << LOREM_IPSUM_STR << "\n" << WIKIPEDIA_STR << "\n" << SOME_TEXT_STR;
+    ofs.close();
+
+    auto& stats { filediff::Stats::Instance() };
+    stats.Reset();
+    SignatureTesting signature { testFile, filediff::Signature::InputFileType::BASIS };
+    EXPECT_EQ(3, stats.Get(filediff::Stats::Counter::CHUNKS_HASHED));
+    EXPECT_EQ(std::filesystem::file_size(testFile), stats.Get(filediff::Stats::Counter::BYTES_READ));
+    const auto phases { stats.GetPhases() };
+    ASSERT_EQ(1, phases.size());
+    EXPECT_EQ("signature hashing", phases[0].first);
+
+    std::stringstream json;
+    stats.Print(json, filediff::Stats::Format::JSON);
+    EXPECT_NE(std::string::npos, json.str().find("\"chunks_hashed\":3"));
+}
+#endif
+
+class SignatureParallelTestSuite : public ::testing::TestWithParam<std::pair<filediff::Signature::ChunkingMode, uint32_t>> {
+};
+
+TEST_P(SignatureParallelTestSuite, SameResultAsSerialTest)
+{
+    // big enough to be split into several partitions, lines of varying length so boundaries fall anywhere
+    const std::string testFile { "test.txt" };
+    std::ofstream ofs { testFile };
+    for (auto i { 0U }; i < 100000; ++i) {
+        ofs << std::string_view { LOREM_IPSUM_STR }.substr(0, i % 97) << i << "\n";
+    }
+    ofs << WIKIPEDIA_STR; // not terminated last line
+    ofs.close();
+
+    const auto [mode, chunkLength] { GetParam() };
+    filediff::ThreadPool pool { 4 };
+    SignatureTesting serial { testFile, filediff::Signature::InputFileType::BASIS, mode, chunkLength };
+    SignatureTesting parallel { testFile, filediff::Signature::InputFileType::BASIS, mode, chunkLength, &pool };
+
+    EXPECT_TRUE(std::ranges::equal(serial.GetHashes(), parallel.GetHashes()));
+    EXPECT_TRUE(std::ranges::equal(serial.GetStrongHashes(), parallel.GetStrongHashes()));
+    std::stringstream serialStream, parallelStream;
+    serial.Serialize(serialStream);
+    parallel.Serialize(parallelStream);
+    EXPECT_EQ(serialStream.str(), parallelStream.str());
+}
+
+INSTANTIATE_TEST_SUITE_P(SignatureParallelTests, SignatureParallelTestSuite,
+    ::testing::Values(std::pair { filediff::Signature::ChunkingMode::LINE, 1U },
+        std::pair { filediff::Signature::ChunkingMode::BLOCK, 1000U }));
+
+class SignatureStreamingTestSuite : public ::testing::TestWithParam<std::pair<filediff::Signature::ChunkingMode, uint32_t>> {
+};
+
+TEST_P(SignatureStreamingTestSuite, ChunksAcrossReadPiecesTest)
+{
+    // file read in several pieces with a line longer than a whole piece, every chunk has to come out as if the file
+    // was hashed at once
+    const std::string testFile { "test.txt" };
+    std::string content;
+    for (auto i { 0U }; content.size() < filediff::ReadPipeline::DEFAULT_BUFFER_SIZE * 3 / 2; ++i) {
+        content += fmt::format("{}{}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 89), i);
+    }
+    for (auto i { 0U }; i < filediff::ReadPipeline::DEFAULT_BUFFER_SIZE + 100; ++i) {
+        content += static_cast<char>('a' + i * 7919 % 26);
+    }
+    content += '\n';
+    for (auto i { 0U }; content.size() < filediff::ReadPipeline::DEFAULT_BUFFER_SIZE * 4; ++i) {
+        content += fmt::format("{} {}\n", i, std::string_view { WIKIPEDIA_STR }.substr(0, i % 10));
+    }
+    content += LOREM_IPSUM_STR; // not terminated last line
+    {
+        std::ofstream ofs { testFile, std::ios::binary };
+        ofs << content;
+    }
+
+    const auto [mode, chunkLength] { GetParam() };
+    const filediff::CdcParameters parameters { 256, chunkLength, chunkLength * 8 };
+    std::vector<uint32_t> expected;
+    filediff::ChunkReader reader { content };
+    while (const auto chunk { mode == filediff::Signature::ChunkingMode::LINE ? reader.NextLine()
+                                   : mode == filediff::Signature::ChunkingMode::BLOCK ? reader.NextBlock(chunkLength)
+                                                                                      : reader.NextChunk(parameters) }) {
+        expected.push_back(filediff::adler32(*chunk));
+    }
+
+    filediff::ThreadPool pool { 4 };
+    for (auto* threads : { static_cast<filediff::ThreadPool*>(nullptr), &pool }) {
+        const auto signature { mode == filediff::Signature::ChunkingMode::CDC
+                ? filediff::Signature { testFile, parameters, threads }
+                : filediff::Signature { testFile, filediff::Signature::InputFileType::BASIS, mode, chunkLength, threads } };
+        EXPECT_TRUE(std::ranges::equal(expected, signature.GetHashes()));
+        EXPECT_EQ(content.size(), signature.GetMetadata().m_fileSize);
+    }
+    std::remove(testFile.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(SignatureStreamingTests, SignatureStreamingTestSuite,
+    ::testing::Values(std::pair { filediff::Signature::ChunkingMode::LINE, 1U },
+        std::pair { filediff::Signature::ChunkingMode::BLOCK, 1000U },
+        std::pair { filediff::Signature::ChunkingMode::CDC, 1024U }));
+
+class SignatureUpdateTestSuite : public ::testing::TestWithParam<std::tuple<filediff::Signature::ChunkingMode, uint32_t, bool>> {
+public:
+    void TearDown() override
+    {
+        std::remove(m_testFile.c_str());
+        std::remove(m_sigFile.c_str());
+    }
+
+    filediff::Signature Calculate()
+    {
+        const auto [mode, chunkLength, strongHashes] { GetParam() };
+        if (mode == filediff::Signature::ChunkingMode::CDC) {
+            return { m_testFile, filediff::CdcParameters { 64, chunkLength, chunkLength * 8 } };
+        }
+        return { m_testFile, filediff::Signature::InputFileType::BASIS, mode, chunkLength, nullptr, strongHashes };
+    }
+
+    void WriteFile(const std::string& content)
+    {
+        std::ofstream ofs { m_testFile, std::ios::binary };
+        ofs << content;
+    }
+
+    std::string Serialized(const filediff::Signature& signature)
+    {
+        std::stringstream stream;
+        signature.Serialize(stream);
+        return stream.str();
+    }
+
+    std::string m_testFile { "test.txt.update" };
+    std::string m_sigFile { "test.txt.update.sig" };
+};
+
+TEST_P(SignatureUpdateTestSuite, AppendedFileSameAsRecalculatedTest)
+{
+    std::string content;
+    for (auto i { 0U }; i < 5000; ++i) {
+        content += fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 41), i);
+    }
+    // once with last line terminated and once with the append continuing it //
+    for (const auto tail : { std::string_view { "\n" }, std::string_view { "unterminated" } }) {
+        WriteFile(content + std::string { tail });
+        {
+            const auto previous { Calculate() };
+            std::ofstream ofSigStream { m_sigFile, std::ios::binary };
+            previous.Serialize(ofSigStream);
+        }
+        WriteFile(content + std::string { tail } + content.substr(0, 20000));
+        const filediff::Signature previous { m_sigFile, filediff::Signature::InputFileType::SIGNATURE };
+        filediff::ThreadPool pool { 3 };
+        const filediff::Signature updated { m_testFile, previous, previous.GetMetadata().m_fileSize, &pool };
+        EXPECT_EQ(Serialized(Calculate()), Serialized(updated));
+    }
+}
+
+TEST_P(SignatureUpdateTestSuite, ChangeAfterUnchangedBytesTest)
+{
+    std::string content;
+    for (auto i { 0U }; i < 5000; ++i) {
+        content += fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 41), i);
+    }
+    WriteFile(content);
+    const auto previous { Calculate() };
+
+    const auto changedAt { content.size() / 2 };
+    content[changedAt] ^= 0x20;
+    WriteFile(content.substr(0, content.size() - 1000));
+    const filediff::Signature updated { m_testFile, previous, changedAt };
+    EXPECT_EQ(Serialized(Calculate()), Serialized(updated));
+
+    EXPECT_THROW(filediff::Signature(m_testFile, previous, content.size()), std::invalid_argument);
+
+    // file rewritten in place instead of appended to is caught by the last reused chunk //
+    std::ranges::replace(content, 'o', 'O');
+    WriteFile(content);
+    EXPECT_THROW(filediff::Signature(m_testFile, previous, previous.GetMetadata().m_fileSize), std::runtime_error);
+}
+
+INSTANTIATE_TEST_SUITE_P(SignatureUpdateTests, SignatureUpdateTestSuite,
+    ::testing::Values(std::tuple { filediff::Signature::ChunkingMode::LINE, 1U, false },
+        std::tuple { filediff::Signature::ChunkingMode::LINE, 1U, true },
+        std::tuple { filediff::Signature::ChunkingMode::BLOCK, 1000U, true },
+        std::tuple { filediff::Signature::ChunkingMode::CDC, 256U, true }));
+
+class SignatureCacheTestSuite : public ::testing::Test {
+public:
+    void TearDown() override
+    {
+        std::filesystem::remove_all(m_cacheDir);
+        std::remove(m_testFile.c_str());
+    }
+
+    void WriteFile(const std::string& content)
+    {
+        std::ofstream ofs { m_testFile, std::ios::binary };
+        ofs << content;
+    }
+
+    filediff::Signature Get(filediff::SignatureCache& cache, const filediff::SignatureCache::Parameters& parameters = {})
+    {
+        return cache.GetOrCalculate(m_testFile, parameters, [&] {
+            m_calculations++;
+            return filediff::Signature { m_testFile, filediff::Signature::InputFileType::BASIS, parameters.m_mode, parameters.m_chunkLength };
+        });
+    }
+
+    size_t NumberOfEntries() const
+    {
+        return std::distance(std::filesystem::directory_iterator { m_cacheDir }, std::filesystem::directory_iterator {});
+    }
+
+    std::string m_cacheDir { "test.cache" };
+    std::string m_testFile { "test.txt.cached" };
+    size_t m_calculations { 0 };
+};
+
+TEST_F(SignatureCacheTestSuite, UnchangedFileIsNotHashedAgainTest)
+{
+    WriteFile(fmt::format("{}\n{}\n", WIKIPEDIA_STR, LOREM_IPSUM_STR));
+    filediff::SignatureCache cache { m_cacheDir, 1 << 20 };
+    std::stringstream calculated, cached;
+    Get(cache).Serialize(calculated);
+    Get(cache).Serialize(cached);
+    EXPECT_EQ(1U, m_calculations);
+    EXPECT_EQ(calculated.str(), cached.str());
+    EXPECT_EQ(1U, NumberOfEntries());
+
+    // other chunking parameters make another entry //
+    Get(cache, { filediff::Signature::ChunkingMode::BLOCK, 64 });
+    EXPECT_EQ(2U, m_calculations);
+
+    // changed file is hashed again //
+    WriteFile(fmt::format("{}\n", SOME_TEXT_STR));
+    std::stringstream updated;
+    Get(cache).Serialize(updated);
+    EXPECT_EQ(3U, m_calculations);
+    EXPECT_NE(calculated.str(), updated.str());
+}
+
+TEST_F(SignatureCacheTestSuite, DamagedEntryIsReplacedTest)
+{
+    WriteFile(fmt::format("{}\n{}\n", WIKIPEDIA_STR, LOREM_IPSUM_STR));
+    filediff::SignatureCache cache { m_cacheDir, 1 << 20 };
+    Get(cache);
+    const auto entry { std::filesystem::directory_iterator { m_cacheDir }->path() };
+    std::filesystem::resize_file(entry, std::filesystem::file_size(entry) - 1);
+
+    Get(cache);
+    Get(cache);
+    EXPECT_EQ(2U, m_calculations);
+}
+
+TEST_F(SignatureCacheTestSuite, LeastRecentlyUsedEntriesAreEvictedTest)
+{
+    WriteFile(std::string(1000, 'x'));
+    // every entry takes 184 bytes, two of them fit //
+    filediff::SignatureCache cache { m_cacheDir, 400 };
+    const auto now { std::filesystem::file_time_type::clock::now() };
+    for (auto blockSize { 100U }; blockSize <= 103; ++blockSize) {
+        Get(cache, { filediff::Signature::ChunkingMode::BLOCK, blockSize });
+        // make the order of entries independent of timestamp granularity //
+        for (const auto& entry : std::filesystem::directory_iterator { m_cacheDir }) {
+            if (entry.path().string().find(fmt::format(".1-{}-", blockSize)) != std::string::npos) {
+                std::filesystem::last_write_time(entry.path(), now - std::chrono::seconds { 200 - blockSize });
+            }
+        }
+    }
+    EXPECT_EQ(2U, NumberOfEntries());
+    EXPECT_EQ(4U, m_calculations);
+
+    // the most recent entry stayed //
+    Get(cache, { filediff::Signature::ChunkingMode::BLOCK, 103 });
+    EXPECT_EQ(4U, m_calculations);
+    Get(cache, { filediff::Signature::ChunkingMode::BLOCK, 100 });
+    EXPECT_EQ(5U, m_calculations);
 }
 
 struct TestingBase {
@@ -115,12 +876,7 @@ struct TestingBase {
     void PrepareSigTestFile(std::vector<uint32_t> hashList)
     {
         SignatureTesting signature { m_dataTestFile, filediff::Signature::InputFileType::BASIS };
-        auto hashes { signature.GetHashes() };
-        EXPECT_EQ(hashList.size(), hashes.size());
-        for (const auto& hash : hashList) {
-            EXPECT_EQ(hash, hashes[0]);
-            hashes.pop_front();
-        }
+        EXPECT_TRUE(std::ranges::equal(hashList, signature.GetHashes()));
 
         std::ofstream ofSigStream { m_signatureTestFile.data(), std::ios::binary };
         if (ofSigStream.is_open()) {
@@ -162,7 +918,7 @@ public:
         {
         }
 
-        const std::deque<std::pair<uint32_t, std::string>>& GetRawDelta() const noexcept
+        const std::pmr::vector<std::pair<uint32_t, std::string_view>>& GetRawDelta() const noexcept
         {
             return Delta::GetRawDelta();
         }
@@ -360,31 +1116,978 @@ TEST_F(DeltaTestSuite, RepeatingLineRemovedTest)
     EXPECT_EQ("", rawDelta[0].second);
 }
 
-// TODO: as described in delta.cpp this is not exactly an error cause now algorithm focuses on finding first matching
-//       chunks but it could be improved to search for more significant matches, or more precisely try to shrink the
-//       scope of the matching 'block' between two matching chunks, it should produce smaller output from --delta
-//       This test case should pass when this is improved.
-TEST_F(DeltaTestSuite, DISABLED_RepeatingAndFollowingLineRemovedTest)
+TEST_F(DeltaTestSuite, LastLineWithoutNewlineAddedTest)
 {
-    PrepareDataTestFile({ WIKIPEDIA_STR, SOME_TEXT_STR, LOREM_IPSUM_STR, WIKIPEDIA_STR, YET_ANOTHER_TEXT_STR });
-    PrepareSigTestFile({ WIKIPEDIA_HASH, SOME_TEXT_HASH, LOREM_IPSUM_HASH, WIKIPEDIA_HASH, YET_ANOTHER_TEXT_HASH });
-    // update data test file //
-    PrepareDataTestFile({ LOREM_IPSUM_STR, WIKIPEDIA_STR, YET_ANOTHER_TEXT_STR });
+    PrepareDataTestFile({ WIKIPEDIA_STR, SOME_TEXT_STR });
+    PrepareSigTestFile({ WIKIPEDIA_HASH, SOME_TEXT_HASH });
+    // update data test file, last line is not terminated //
+    std::ofstream ofs { m_dataTestFile.data() };
+    ofs << LOREM_IPSUM_STR << "\n"
+        << WIKIPEDIA_STR << "\n"
+        << SOME_TEXT_STR << "\n"
+        << YET_ANOTHER_TEXT_STR;
+    ofs.close();
 
     DeltaTesting delta { m_signatureTestFile, m_dataTestFile };
     delta.Calculate();
-    EXPECT_TRUE(delta.IsChanged());
 
     const auto& rawDelta { delta.GetRawDelta() };
+    ASSERT_EQ(2, rawDelta.size());
+    EXPECT_EQ(LOREM_IPSUM_HASH, rawDelta[0].first);
+    EXPECT_EQ(LOREM_IPSUM_STR, rawDelta[0].second);
+    EXPECT_EQ(YET_ANOTHER_TEXT_HASH, rawDelta[1].first);
+    EXPECT_EQ(YET_ANOTHER_TEXT_STR, rawDelta[1].second);
+}
 
-    constexpr auto EXPECTED_NUMBER_OF_ENTRIES_IN_DELTA { 2 };
-    ASSERT_EQ(EXPECTED_NUMBER_OF_ENTRIES_IN_DELTA, rawDelta.size());
-
-    // verify if line was removed from the file //
+TEST_F(DeltaTestSuite, StreamingSinkReceivesSameRecordsTest)
+{
+    PrepareDataTestFile({ WIKIPEDIA_STR, SOME_TEXT_STR, LOREM_IPSUM_STR });
+    PrepareSigTestFile({ WIKIPEDIA_HASH, SOME_TEXT_HASH, LOREM_IPSUM_HASH });
+    // update data test file //
+    PrepareDataTestFile({ YET_ANOTHER_TEXT_STR, LOREM_IPSUM_STR, SOME_TEXT_STR, WIKIPEDIA_STR });
+
+    DeltaTesting collected { m_signatureTestFile, m_dataTestFile };
+    collected.Calculate();
+    std::stringstream serialized;
+    collected.SerializeDelta(serialized);
+
+    DeltaTesting streamed { m_signatureTestFile, m_dataTestFile };
+    std::vector<std::pair<uint32_t, std::string_view>> records;
+    streamed.Calculate([&records](uint32_t hash, std::string_view chunk) { records.emplace_back(hash, chunk); });
+    EXPECT_TRUE(streamed.IsChanged());
+    EXPECT_TRUE(streamed.GetRawDelta().empty());
+    EXPECT_TRUE(std::ranges::equal(collected.GetRawDelta(), records));
+
+    std::stringstream streamedOut;
+    streamed.Calculate(filediff::Delta::StreamSink(streamedOut));
+    EXPECT_EQ(serialized.str(), streamedOut.str());
+}
+
+TEST_F(DeltaTestSuite, IndexedAndLinearEnginesProduceSameDeltaTest)
+{
+    const std::vector<std::string> baseLines { WIKIPEDIA_STR, SOME_TEXT_STR, LOREM_IPSUM_STR, WIKIPEDIA_STR,
+        YET_ANOTHER_TEXT_STR, SOME_TEXT_STR, "", LOREM_IPSUM_STR };
+    PrepareDataTestFile(baseLines);
+    PrepareSigTestFile({ WIKIPEDIA_HASH, SOME_TEXT_HASH, LOREM_IPSUM_HASH, WIKIPEDIA_HASH, YET_ANOTHER_TEXT_HASH,
+        SOME_TEXT_HASH, filediff::adler32(""), LOREM_IPSUM_HASH });
+    // update data test file //
+    PrepareDataTestFile({ LOREM_IPSUM_STR, "", WIKIPEDIA_STR, "new line", YET_ANOTHER_TEXT_STR, WIKIPEDIA_STR,
+        SOME_TEXT_STR, "", LOREM_IPSUM_STR, "another new line" });
+
+    DeltaTesting indexed { m_signatureTestFile, m_dataTestFile };
+    indexed.Calculate(filediff::Delta::MatchingEngine::INDEXED);
+    DeltaTesting linear { m_signatureTestFile, m_dataTestFile };
+    linear.Calculate(filediff::Delta::MatchingEngine::LINEAR);
+
+    EXPECT_TRUE(indexed.IsChanged());
+    EXPECT_EQ(linear.GetRawDelta(), indexed.GetRawDelta());
+}
+
+TEST_F(DeltaTestSuite, StrongHashesRejectAdler32CollisionTest)
+{
+    // "bdb" and "cbc" differ by (+1, -2, +1) which leaves both adler32 sums unchanged //
+    ASSERT_EQ(filediff::adler32("bdb"), filediff::adler32("cbc"));
+    auto prepareFiles = [this](bool strongHashes) {
+        PrepareDataTestFile({ WIKIPEDIA_STR, "bdb", LOREM_IPSUM_STR });
+        {
+            SignatureTesting signature { m_dataTestFile, filediff::Signature::InputFileType::BASIS, filediff::Signature::ChunkingMode::LINE, 1,
+                nullptr, strongHashes };
+            std::ofstream ofSigStream { m_signatureTestFile.data(), std::ios::binary };
+            signature.Serialize(ofSigStream);
+        }
+        PrepareDataTestFile({ WIKIPEDIA_STR, "cbc", LOREM_IPSUM_STR });
+    };
+
+    // weak hashes alone take the changed line for unchanged one //
+    prepareFiles(false);
+    DeltaTesting weakDelta { m_signatureTestFile, m_dataTestFile };
+    weakDelta.Calculate();
+    EXPECT_FALSE(weakDelta.IsChanged());
+
+    prepareFiles(true);
+    DeltaTesting delta { m_signatureTestFile, m_dataTestFile };
+    delta.Calculate();
+    EXPECT_TRUE(delta.IsChanged());
+    const std::array<std::pair<std::uint32_t, std::string_view>, 2> EXPECTED_DELTA_COLLECTION {
+        std::make_pair(filediff::adler32("bdb"), std::string_view { "" }),
+        std::make_pair(filediff::adler32("cbc"), std::string_view { "cbc" })
+    };
+    const auto& rawDelta { delta.GetRawDelta() };
+    ASSERT_EQ(EXPECTED_DELTA_COLLECTION.size(), rawDelta.size());
+    for (auto i { 0U }; i < rawDelta.size(); ++i) {
+        EXPECT_EQ(EXPECTED_DELTA_COLLECTION[i].first, rawDelta[i].first);
+        EXPECT_EQ(EXPECTED_DELTA_COLLECTION[i].second, rawDelta[i].second);
+    }
+}
+
+TEST_F(DeltaTestSuite, BlockModeBytesInsertedAtAnyOffsetTest)
+{
+    constexpr auto BLOCK_SIZE { 32U };
+    const std::string base { LOREM_IPSUM_STR };
+    PrepareDataTestFile({ base });
+    {
+        SignatureTesting signature { m_dataTestFile, filediff::Signature::InputFileType::BASIS, filediff::Signature::ChunkingMode::BLOCK, BLOCK_SIZE };
+        std::ofstream ofSigStream { m_signatureTestFile.data(), std::ios::binary };
+        signature.Serialize(ofSigStream);
+    }
+
+    // insert few bytes in the middle of the second block and drop the fifth block entirely //
+    auto updated { base + "\n" };
+    updated.erase(4 * BLOCK_SIZE, BLOCK_SIZE);
+    updated.insert(BLOCK_SIZE + 5, "XYZ");
+    std::ofstream ofs { m_dataTestFile.data(), std::ios::binary };
+    ofs << updated;
+    ofs.close();
+
+    DeltaTesting delta { m_signatureTestFile, m_dataTestFile };
+    delta.Calculate();
+    EXPECT_TRUE(delta.IsChanged());
+
+    const std::string_view text { base + "\n" };
+    const std::array<std::pair<std::uint32_t, std::string_view>, 3> EXPECTED_DELTA_COLLECTION {
+        std::make_pair(filediff::adler32(updated.substr(BLOCK_SIZE, BLOCK_SIZE + 3)), std::string_view { updated }.substr(BLOCK_SIZE, BLOCK_SIZE + 3)),
+        std::make_pair(filediff::adler32(text.substr(BLOCK_SIZE, BLOCK_SIZE)), std::string_view { "" }),
+        std::make_pair(filediff::adler32(text.substr(4 * BLOCK_SIZE, BLOCK_SIZE)), std::string_view { "" })
+    };
+    const auto& rawDelta { delta.GetRawDelta() };
+    ASSERT_EQ(EXPECTED_DELTA_COLLECTION.size(), rawDelta.size());
+    for (auto i { 0U }; i < rawDelta.size(); ++i) {
+        EXPECT_EQ(EXPECTED_DELTA_COLLECTION[i].first, rawDelta[i].first);
+        EXPECT_EQ(EXPECTED_DELTA_COLLECTION[i].second, rawDelta[i].second);
+    }
+}
+
+TEST_F(DeltaTestSuite, BinaryFormatCoalescesCopiesAndLiteralsTest)
+{
+    constexpr auto BLOCK_SIZE { 32U };
+    const std::string base { LOREM_IPSUM_STR };
+    PrepareDataTestFile({ base });
+    {
+        SignatureTesting signature { m_dataTestFile, filediff::Signature::InputFileType::BASIS, filediff::Signature::ChunkingMode::BLOCK, BLOCK_SIZE };
+        std::ofstream ofSigStream { m_signatureTestFile.data(), std::ios::binary };
+        signature.Serialize(ofSigStream);
+    }
+
+    // insert few bytes in the middle of the second block and drop the fifth block entirely //
+    auto updated { base + "\n" };
+    updated.erase(4 * BLOCK_SIZE, BLOCK_SIZE);
+    updated.insert(BLOCK_SIZE + 5, "XYZ");
+    std::ofstream ofs { m_dataTestFile.data(), std::ios::binary };
+    ofs << updated;
+    ofs.close();
+
+    filediff::Delta delta { m_signatureTestFile, m_dataTestFile };
+    std::stringstream binary;
+    filediff::BinaryDeltaWriter writer { binary, delta.GetSignatureMetadata() };
+    delta.CalculateInstructions(std::ref(writer));
+    const auto encoded { binary.str() };
+
+    filediff::BinaryDeltaReader reader { encoded };
+    EXPECT_EQ(filediff::Signature::ChunkingMode::BLOCK, reader.GetHeader().m_mode);
+    EXPECT_EQ(BLOCK_SIZE, reader.GetHeader().m_chunkLength);
+
+    // rebuild updated file from base one and check every record on the way
+    const std::string baseContent { base + "\n" };
+    const std::string_view baseView { baseContent };
+    std::string rebuilt;
+    std::vector<filediff::BinaryDeltaReader::Record::Type> types;
+    while (const auto record { reader.Next() }) {
+        types.push_back(record->m_type);
+        if (record->m_type == filediff::BinaryDeltaReader::Record::Type::COPY) {
+            rebuilt += baseView.substr(record->m_firstChunk * BLOCK_SIZE, record->m_numberOfChunks * BLOCK_SIZE);
+        } else if (record->m_type == filediff::BinaryDeltaReader::Record::Type::LITERAL) {
+            rebuilt += record->m_literal;
+        } else {
+            EXPECT_EQ(updated.size(), record->m_fileSize);
+            EXPECT_EQ(filediff::xxhash64(updated), record->m_checksum);
+        }
+    }
+    EXPECT_EQ(updated, rebuilt);
+
+    using Type = filediff::BinaryDeltaReader::Record::Type;
+    // block 0, literal covering modified block 1, blocks 2-3, blocks 5 up to the end, end
+    const std::vector<Type> EXPECTED_TYPES { Type::COPY, Type::LITERAL, Type::COPY, Type::COPY, Type::END };
+    EXPECT_EQ(EXPECTED_TYPES, types);
+    EXPECT_LT(encoded.size(), updated.size() / 2);
+}
+
+TEST_F(DeltaTestSuite, ContentDefinedChunksSurviveInsertionTest)
+{
+    constexpr filediff::CdcParameters CDC { 256, 1024, 8192 };
+    std::string base;
+    std::mt19937 generator { 7 };
+    for (auto i { 0U }; i < 200000; ++i) {
+        base += static_cast<char>(generator()); // binary content without line structure
+    }
+    const std::string basisFile { "test.txt.base" };
+    const std::string deltaFile { "test.txt.delta" };
+    const std::string patchedFile { "test.txt.patched" };
+    {
+        std::ofstream ofs { basisFile, std::ios::binary };
+        ofs << base;
+    }
+    {
+        const filediff::Signature signature { basisFile, CDC };
+        EXPECT_EQ(filediff::Signature::ChunkingMode::CDC, signature.GetMetadata().m_mode);
+        EXPECT_EQ(signature.GetHashes().size(), signature.GetStrongHashes().size());
+        EXPECT_GT(signature.GetHashes().size(), base.size() / CDC.m_maxLength);
+        std::ofstream ofSigStream { m_signatureTestFile.data(), std::ios::binary };
+        signature.Serialize(ofSigStream);
+    }
+    SignatureTesting loaded { m_signatureTestFile, filediff::Signature::InputFileType::SIGNATURE };
+    EXPECT_EQ(CDC.m_minLength, loaded.GetMetadata().m_minChunkLength);
+    EXPECT_EQ(CDC.m_averageLength, loaded.GetMetadata().m_chunkLenght);
+    EXPECT_EQ(CDC.m_maxLength, loaded.GetMetadata().m_maxChunkLength);
+
+    // bytes inserted near the beginning shift everything after them //
+    auto updated { base };
+    updated.insert(1000, "inserted bytes");
+    {
+        std::ofstream ofs { m_dataTestFile.data(), std::ios::binary };
+        ofs << updated;
+    }
+
+    filediff::Delta delta { m_signatureTestFile, m_dataTestFile };
+    size_t copiedBytes { 0 }, literalBytes { 0 };
+    std::stringstream binary;
+    filediff::BinaryDeltaWriter writer { binary, delta.GetSignatureMetadata() };
+    delta.CalculateInstructions([&](const filediff::Delta::Instruction& instruction) {
+        if (instruction.m_type == filediff::Delta::Instruction::Type::COPY) {
+            copiedBytes += instruction.m_data.size();
+        } else if (instruction.m_type == filediff::Delta::Instruction::Type::LITERAL) {
+            literalBytes += instruction.m_data.size();
+        }
+        writer(instruction);
+    });
+    EXPECT_EQ(updated.size(), copiedBytes + literalBytes);
+    EXPECT_LT(literalBytes, 3 * CDC.m_maxLength);
+    {
+        std::ofstream ofs { deltaFile, std::ios::binary };
+        ofs << binary.str();
+    }
+
+    filediff::Patch patch { basisFile, deltaFile };
+    patch.Apply(patchedFile);
+    std::ifstream ifs { patchedFile, std::ios::binary };
+    EXPECT_EQ(updated, std::string(std::istreambuf_iterator<char> { ifs }, std::istreambuf_iterator<char> {}));
+    std::remove(basisFile.c_str());
+    std::remove(deltaFile.c_str());
+    std::remove(patchedFile.c_str());
+}
+
+TEST(CdcTestSuite, ChunkLengthsStayWithinLimitsTest)
+{
+    constexpr filediff::CdcParameters CDC { 64, 256, 1024 };
+    std::string data(100000, 'a'); // no content to cut on, every chunk ends at maximal length
+    filediff::ChunkReader reader { data };
+    while (const auto chunk { reader.NextChunk(CDC) }) {
+        EXPECT_TRUE(chunk->size() == CDC.m_maxLength || reader.Position() == data.size());
+    }
+
+    std::mt19937 generator { 7 };
+    std::generate(std::begin(data), std::end(data), [&generator] { return static_cast<char>(generator()); });
+    filediff::ChunkReader randomReader { data };
+    size_t numberOfChunks { 0 };
+    while (const auto chunk { randomReader.NextChunk(CDC) }) {
+        numberOfChunks++;
+        EXPECT_LE(chunk->size(), CDC.m_maxLength);
+        EXPECT_TRUE(chunk->size() >= CDC.m_minLength || randomReader.Position() == data.size());
+    }
+    // normalized chunking keeps average close to the requested one //
+    EXPECT_NEAR(static_cast<double>(data.size()) / numberOfChunks, CDC.m_averageLength, CDC.m_averageLength / 2.0);
+    EXPECT_THROW(filediff::ValidateCdcParameters({ 16, 256, 1024 }), std::invalid_argument);
+}
+
+TEST_F(DeltaTestSuite, BlockModeSameFileNoChangeTest)
+{
+    PrepareDataTestFile({ LOREM_IPSUM_STR, WIKIPEDIA_STR });
+    {
+        SignatureTesting signature { m_dataTestFile, filediff::Signature::InputFileType::BASIS, filediff::Signature::ChunkingMode::BLOCK, 64 };
+        std::ofstream ofSigStream { m_signatureTestFile.data(), std::ios::binary };
+        signature.Serialize(ofSigStream);
+    }
+
+    filediff::Delta delta { m_signatureTestFile, m_dataTestFile };
+    delta.Calculate();
+    EXPECT_FALSE(delta.IsChanged());
+}
+
+class DeltaParallelTestSuite : public TestingBase, public ::testing::TestWithParam<std::pair<filediff::Signature::ChunkingMode, uint32_t>> {
+};
+
+TEST_P(DeltaParallelTestSuite, SameDeltaAsSerialTest)
+{
+    const auto [mode, chunkLength] { GetParam() };
+    auto writeLines = [this](auto&& lineFor) {
+        std::ofstream ofs { m_dataTestFile.data() };
+        for (auto i { 0U }; i < 100000; ++i) {
+            ofs << lineFor(i) << "\n";
+        }
+    };
+
+    writeLines([](auto i) { return fmt::format("{} {}", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 97), i); });
+    {
+        SignatureTesting signature { m_dataTestFile, filediff::Signature::InputFileType::BASIS, mode, chunkLength };
+        std::ofstream ofSigStream { m_signatureTestFile.data(), std::ios::binary };
+        signature.Serialize(ofSigStream);
+    }
+    // update data test file: some lines edited, some moved and some removed //
+    writeLines([](auto i) {
+        if (i % 1013 == 0) {
+            return fmt::format("edited {}", i);
+        }
+        const auto source { i % 4099 == 1 ? i + 7 : i % 3001 == 2 ? i - 1 : i };
+        return fmt::format("{} {}", std::string_view { LOREM_IPSUM_STR }.substr(0, source % 97), source);
+    });
+
+    filediff::ThreadPool pool { 4 };
+    EvictFromPageCache(std::string { m_dataTestFile });
+    DeltaTestSuite::DeltaTesting serial { m_signatureTestFile, m_dataTestFile };
+    serial.Calculate();
+    EvictFromPageCache(std::string { m_dataTestFile });
+    DeltaTestSuite::DeltaTesting parallel { m_signatureTestFile, m_dataTestFile };
+    parallel.Calculate(filediff::Delta::MatchingEngine::INDEXED, &pool);
+
+    EXPECT_TRUE(serial.IsChanged());
+    EXPECT_EQ(serial.GetRawDelta(), parallel.GetRawDelta());
+    if (mode == filediff::Signature::ChunkingMode::LINE) {
+        // data file is parsed in read pieces, no line cut by their ends is lost or split
+        EXPECT_EQ(99, std::ranges::count_if(serial.GetRawDelta(), [](const auto& record) { return record.second.starts_with("edited "); }));
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(DeltaParallelTests, DeltaParallelTestSuite,
+    ::testing::Values(std::pair { filediff::Signature::ChunkingMode::LINE, 1U },
+        std::pair { filediff::Signature::ChunkingMode::BLOCK, 700U }));
+
+class PatchTestSuite : public TestingBase, public ::testing::TestWithParam<std::tuple<filediff::Signature::ChunkingMode, uint32_t, bool>> {
+public:
+    void TearDown() override
+    {
+        std::remove(m_basisTestFile.data());
+        std::remove(m_deltaTestFile.data());
+        std::remove(m_patchedTestFile.data());
+    }
+
+    void WriteFile(std::string_view fileName, const std::string& content)
+    {
+        std::ofstream ofs { fileName.data(), std::ios::binary };
+        ofs << content;
+    }
+
+    std::string ReadFile(std::string_view fileName)
+    {
+        std::ifstream ifs { fileName.data(), std::ios::binary };
+        return { std::istreambuf_iterator<char> { ifs }, std::istreambuf_iterator<char> {} };
+    }
+
+    std::string_view m_basisTestFile { "test.txt.base" };
+    std::string_view m_deltaTestFile { "test.txt.delta" };
+    std::string_view m_patchedTestFile { "test.txt.patched" };
+};
+
+TEST_P(PatchTestSuite, RebuildsUpdatedFileTest)
+{
+    const auto [mode, chunkLength, trailingNewline] { GetParam() };
+    std::string base, updated;
+    for (auto i { 0U }; i < 5000; ++i) {
+        base += fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 53), i);
+        updated += i % 701 == 0 ? fmt::format("edited {}\n", i) : fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, (i ^ 1) % 53), i ^ 1);
+    }
+    // base file without the last line terminator, its last line is copied into the updated file //
+    base.pop_back();
+    updated += std::string_view { base }.substr(base.rfind('\n') + 1);
+    if (trailingNewline) {
+        updated += "\n";
+    }
+    WriteFile(m_basisTestFile, base);
+    WriteFile(m_dataTestFile, updated);
+    {
+        SignatureTesting signature { m_basisTestFile, filediff::Signature::InputFileType::BASIS, mode, chunkLength, nullptr, true };
+        std::ofstream ofSigStream { m_signatureTestFile.data(), std::ios::binary };
+        signature.Serialize(ofSigStream);
+    }
+    {
+        filediff::Delta delta { m_signatureTestFile, m_dataTestFile };
+        std::ofstream ofDeltaStream { m_deltaTestFile.data(), std::ios::binary };
+        filediff::BinaryDeltaWriter writer { ofDeltaStream, delta.GetSignatureMetadata() };
+        delta.CalculateInstructions(std::ref(writer));
+    }
+
+    filediff::Patch patch { m_basisTestFile, m_deltaTestFile };
+    patch.Apply(m_patchedTestFile);
+    EXPECT_EQ(updated, ReadFile(m_patchedTestFile));
+}
+
+TEST_P(PatchTestSuite, ChecksumMismatchLeavesNoOutputTest)
+{
+    const auto [mode, chunkLength, trailingNewline] { GetParam() };
+    WriteFile(m_basisTestFile, fmt::format("{}\n{}\n", LOREM_IPSUM_STR, WIKIPEDIA_STR));
+    WriteFile(m_dataTestFile, fmt::format("{}\n{}\n{}\n", WIKIPEDIA_STR, SOME_TEXT_STR, LOREM_IPSUM_STR));
+    {
+        SignatureTesting signature { m_basisTestFile, filediff::Signature::InputFileType::BASIS, mode, chunkLength, nullptr, true };
+        std::ofstream ofSigStream { m_signatureTestFile.data(), std::ios::binary };
+        signature.Serialize(ofSigStream);
+    }
+    std::stringstream binary;
+    {
+        filediff::Delta delta { m_signatureTestFile, m_dataTestFile };
+        filediff::BinaryDeltaWriter writer { binary, delta.GetSignatureMetadata() };
+        delta.CalculateInstructions(std::ref(writer));
+    }
+    // corrupt one byte of the literal //
+    auto encoded { binary.str() };
+    const auto literal { encoded.find(SOME_TEXT_STR) };
+    ASSERT_NE(std::string::npos, literal);
+    encoded[literal] ^= 0x20;
+    WriteFile(m_deltaTestFile, encoded);
+
+    filediff::Patch patch { m_basisTestFile, m_deltaTestFile };
+    EXPECT_THROW(patch.Apply(m_patchedTestFile), std::runtime_error);
+    struct stat buffer;
+    EXPECT_NE(0, stat(m_patchedTestFile.data(), &buffer));
+    EXPECT_NE(0, stat(fmt::format("{}.tmp", m_patchedTestFile).c_str(), &buffer));
+}
+
+TEST_P(PatchTestSuite, PatienceAlignmentRebuildsUpdatedFileTest)
+{
+    const auto [mode, chunkLength, trailingNewline] { GetParam() };
+    if (mode != filediff::Signature::ChunkingMode::LINE) {
+        GTEST_SKIP() << "alignment applies to LINE mode only";
+    }
+    std::string base, updated;
+    std::vector<std::string> lines;
+    for (auto i { 0U }; i < 3000; ++i) {
+        lines.push_back(fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 53), i % 997));
+        base += lines.back();
+    }
+    // blocks of lines are moved around, some lines are edited and some dropped //
+    std::rotate(lines.begin() + 100, lines.begin() + 900, lines.begin() + 1500);
+    for (auto i { 0U }; i < lines.size(); ++i) {
+        if (i % 409 == 0) {
+            updated += fmt::format("edited {}\n", i);
+        } else if (i % 211 != 0) {
+            updated += lines[i];
+        }
+    }
+    if (!trailingNewline) {
+        updated.pop_back();
+    }
+    WriteFile(m_basisTestFile, base);
+    WriteFile(m_dataTestFile, updated);
+    {
+        SignatureTesting signature { m_basisTestFile, filediff::Signature::InputFileType::BASIS, mode, chunkLength, nullptr, true };
+        std::ofstream ofSigStream { m_signatureTestFile.data(), std::ios::binary };
+        signature.Serialize(ofSigStream);
+    }
+    std::string greedyDelta;
+    {
+        filediff::Delta delta { m_signatureTestFile, m_dataTestFile };
+        std::stringstream binary;
+        filediff::BinaryDeltaWriter writer { binary, delta.GetSignatureMetadata() };
+        delta.CalculateInstructions(std::ref(writer));
+        greedyDelta = binary.str();
+    }
+    {
+        filediff::Delta delta { m_signatureTestFile, m_dataTestFile };
+        std::ofstream ofDeltaStream { m_deltaTestFile.data(), std::ios::binary };
+        filediff::BinaryDeltaWriter writer { ofDeltaStream, delta.GetSignatureMetadata() };
+        delta.CalculateInstructions(std::ref(writer), filediff::Delta::MatchingEngine::PATIENCE);
+    }
+    EXPECT_LT(ReadFile(m_deltaTestFile).size(), greedyDelta.size());
+
+    filediff::Patch patch { m_basisTestFile, m_deltaTestFile };
+    patch.Apply(m_patchedTestFile);
+    EXPECT_EQ(updated, ReadFile(m_patchedTestFile));
+}
+
+TEST_P(PatchTestSuite, CompressedLiteralsRebuildUpdatedFileTest)
+{
+    const auto [mode, chunkLength, trailingNewline] { GetParam() };
+    // literals of over two blocks, most of them short lines between copied ones //
+    std::string base, updated;
+    for (auto i { 0U }; i < 60000; ++i) {
+        const auto line { fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 67), i) };
+        base += line;
+        updated += i % 3 == 0 ? line : fmt::format("changed {} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 59), i);
+    }
+    if (!trailingNewline) {
+        updated.pop_back();
+    }
+    WriteFile(m_basisTestFile, base);
+    WriteFile(m_dataTestFile, updated);
+    {
+        // thousands of short similar lines, weak line hashes alone would collide //
+        SignatureTesting signature { m_basisTestFile, filediff::Signature::InputFileType::BASIS, mode, chunkLength, nullptr, true };
+        std::ofstream ofSigStream { m_signatureTestFile.data(), std::ios::binary };
+        signature.Serialize(ofSigStream);
+    }
+    std::stringstream uncompressed;
+    {
+        filediff::Delta delta { m_signatureTestFile, m_dataTestFile };
+        filediff::BinaryDeltaWriter writer { uncompressed, delta.GetSignatureMetadata() };
+        delta.CalculateInstructions(std::ref(writer));
+    }
+
+    for (const auto type : { filediff::CodecType::ZLIB, filediff::CodecType::ZSTD, filediff::CodecType::LZ4 }) {
+        if (!filediff::IsCodecAvailable(type)) {
+            continue;
+        }
+        const auto codec { filediff::MakeCodec(type) };
+        {
+            filediff::Delta delta { m_signatureTestFile, m_dataTestFile };
+            std::ofstream ofDeltaStream { m_deltaTestFile.data(), std::ios::binary };
+            filediff::BinaryDeltaWriter writer { ofDeltaStream, delta.GetSignatureMetadata(), codec.get() };
+            delta.CalculateInstructions(std::ref(writer));
+        }
+        const auto compressed { ReadFile(m_deltaTestFile) };
+        EXPECT_LT(compressed.size() * 3, uncompressed.str().size()) << filediff::CodecName(type);
+
+        // same records come out of both deltas //
+        const auto plain { uncompressed.str() };
+        filediff::BinaryDeltaReader plainReader { plain };
+        filediff::BinaryDeltaReader compressedReader { compressed };
+        EXPECT_EQ(type, compressedReader.GetHeader().m_codec);
+        std::string plainLiterals, compressedLiterals;
+        while (const auto record { plainReader.Next() }) {
+            if (record->m_type == filediff::BinaryDeltaReader::Record::Type::LITERAL) {
+                plainLiterals += record->m_literal;
+            }
+        }
+        while (const auto record { compressedReader.Next() }) {
+            if (record->m_type == filediff::BinaryDeltaReader::Record::Type::LITERAL) {
+                compressedLiterals += record->m_literal;
+            }
+        }
+        EXPECT_EQ(plainLiterals, compressedLiterals);
+
+        filediff::Patch patch { m_basisTestFile, m_deltaTestFile };
+        patch.Apply(m_patchedTestFile);
+        EXPECT_EQ(updated, ReadFile(m_patchedTestFile)) << filediff::CodecName(type);
+    }
+}
+
+TEST_P(PatchTestSuite, UnverifiedLineCopiesAreRefusedTest)
+{
+    const auto [mode, chunkLength, trailingNewline] { GetParam() };
+    if (mode != filediff::Signature::ChunkingMode::LINE) {
+        GTEST_SKIP() << "copies are always verified in BLOCK mode";
+    }
+    // line of basis collides in adler32 with the updated one, delta made without strong hashes copies it //
+    const std::string updated { "bab\n" };
+    ASSERT_EQ(filediff::adler32("aca"), filediff::adler32("bab"));
+    WriteFile(m_basisTestFile, "aca\n");
+    std::string delta { "FDDL\x01\x00\x01", 7 };
+    delta += std::string { "\x01\x00\x01\x00\x04", 5 };
+    const auto checksum { filediff::xxhash64(updated) };
+    for (auto i { 0U }; i < sizeof(checksum); ++i) {
+        delta += static_cast<char>(checksum >> (8 * i));
+    }
+    WriteFile(m_deltaTestFile, delta);
+
+    try {
+        filediff::Patch patch { m_basisTestFile, m_deltaTestFile };
+        patch.Apply(m_patchedTestFile);
+        FAIL() << "unverified delta was applied";
+    } catch (const std::runtime_error& e) {
+        EXPECT_NE(std::string_view { e.what() }.find("--strong-hash"), std::string_view::npos) << e.what();
+    }
+    struct stat buffer;
+    EXPECT_NE(0, stat(m_patchedTestFile.data(), &buffer));
+}
+
+INSTANTIATE_TEST_SUITE_P(PatchTests, PatchTestSuite,
+    ::testing::Values(std::tuple { filediff::Signature::ChunkingMode::LINE, 1U, true },
+        std::tuple { filediff::Signature::ChunkingMode::LINE, 1U, false },
+        std::tuple { filediff::Signature::ChunkingMode::BLOCK, 64U, true },
+        std::tuple { filediff::Signature::ChunkingMode::BLOCK, 64U, false }));
+
+TEST_F(DeltaTestSuite, RepeatingAndFollowingLineRemovedTest)
+{
+    PrepareDataTestFile({ WIKIPEDIA_STR, SOME_TEXT_STR, LOREM_IPSUM_STR, WIKIPEDIA_STR, YET_ANOTHER_TEXT_STR });
+    PrepareSigTestFile({ WIKIPEDIA_HASH, SOME_TEXT_HASH, LOREM_IPSUM_HASH, WIKIPEDIA_HASH, YET_ANOTHER_TEXT_HASH });
+    // update data test file //
+    PrepareDataTestFile({ LOREM_IPSUM_STR, WIKIPEDIA_STR, YET_ANOTHER_TEXT_STR });
+
+    // greedy matching takes the first Wikipedia for the kept one, alignment finds the longer common run //
+    DeltaTesting delta { m_signatureTestFile, m_dataTestFile };
+    delta.Calculate(filediff::Delta::MatchingEngine::PATIENCE);
+    EXPECT_TRUE(delta.IsChanged());
+
+    const auto& rawDelta { delta.GetRawDelta() };
+
+    constexpr auto EXPECTED_NUMBER_OF_ENTRIES_IN_DELTA { 2 };
+    ASSERT_EQ(EXPECTED_NUMBER_OF_ENTRIES_IN_DELTA, rawDelta.size());
+
+    // verify if line was removed from the file //
     EXPECT_EQ(WIKIPEDIA_HASH, rawDelta[0].first);
     EXPECT_EQ("", rawDelta[0].second);
     EXPECT_EQ(SOME_TEXT_HASH, rawDelta[1].first);
     EXPECT_EQ("", rawDelta[1].second);
 }
 
+TEST_F(DeltaTestSuite, PatienceAlignmentReusesMovedLinesTest)
+{
+    PrepareDataTestFile({ WIKIPEDIA_STR, LOREM_IPSUM_STR, SOME_TEXT_STR });
+    PrepareSigTestFile({ WIKIPEDIA_HASH, LOREM_IPSUM_HASH, SOME_TEXT_HASH });
+    // update data test file //
+    PrepareDataTestFile({ YET_ANOTHER_TEXT_STR, SOME_TEXT_STR, LOREM_IPSUM_STR, WIKIPEDIA_STR });
+
+    DeltaTesting delta { m_signatureTestFile, m_dataTestFile };
+    std::vector<filediff::Delta::Instruction> instructions;
+    delta.CalculateInstructions([&instructions](const filediff::Delta::Instruction& instruction) { instructions.push_back(instruction); },
+        filediff::Delta::MatchingEngine::PATIENCE);
+    EXPECT_TRUE(delta.IsChanged());
+
+    // only the new line is a literal, reordered lines are copied from their old places and nothing is removed //
+    using Type = filediff::Delta::Instruction::Type;
+    const std::vector<std::pair<Type, size_t>> EXPECTED_INSTRUCTIONS { { Type::LITERAL, 0 }, { Type::COPY, 2 }, { Type::COPY, 1 },
+        { Type::COPY, 0 }, { Type::END, 0 } };
+    ASSERT_EQ(EXPECTED_INSTRUCTIONS.size(), instructions.size());
+    for (auto i { 0U }; i < instructions.size(); ++i) {
+        EXPECT_EQ(EXPECTED_INSTRUCTIONS[i].first, instructions[i].m_type);
+        EXPECT_EQ(EXPECTED_INSTRUCTIONS[i].second, instructions[i].m_baseChunk);
+    }
+
+    delta.Calculate(filediff::Delta::MatchingEngine::PATIENCE);
+    const auto& rawDelta { delta.GetRawDelta() };
+    ASSERT_EQ(1U, rawDelta.size());
+    EXPECT_EQ(YET_ANOTHER_TEXT_HASH, rawDelta[0].first);
+    EXPECT_EQ(YET_ANOTHER_TEXT_STR, rawDelta[0].second);
+}
+
+class BatchTestSuite : public ::testing::Test {
+public:
+    void TearDown() override
+    {
+        for (const auto& fileName : m_createdFiles) {
+            std::remove(fileName.c_str());
+        }
+    }
+
+    std::string WriteFile(const std::string& fileName, const std::string& content)
+    {
+        std::ofstream ofs { fileName, std::ios::binary };
+        ofs << content;
+        m_createdFiles.push_back(fileName);
+        return fileName;
+    }
+
+    std::string ReadFile(const std::string& fileName)
+    {
+        std::ifstream ifs { fileName, std::ios::binary };
+        return { std::istreambuf_iterator<char> { ifs }, std::istreambuf_iterator<char> {} };
+    }
+
+    std::vector<std::string> m_createdFiles;
+};
+
+TEST_F(BatchTestSuite, EveryJobWrittenAsSingleDeltaTest)
+{
+    constexpr auto NUMBER_OF_JOBS { 6U };
+    std::string manifest { "# sigfile newdata outfile\n\n" };
+    std::vector<std::string> expectedDeltas;
+    for (auto job { 0U }; job < NUMBER_OF_JOBS; ++job) {
+        std::string base, updated;
+        for (auto i { 0U }; i < 200 * (job + 1); ++i) {
+            base += fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 31), i);
+            updated += fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 31), i % 17 == job ? i + 1 : i);
+        }
+        const auto baseFile { WriteFile(fmt::format("test.batch{}.base", job), base) };
+        const auto sigFile { fmt::format("test.batch{}.sig", job) };
+        {
+            SignatureTesting signature { baseFile, filediff::Signature::InputFileType::BASIS, filediff::Signature::ChunkingMode::LINE, 1,
+                nullptr, true };
+            std::ofstream ofSigStream { sigFile, std::ios::binary };
+            signature.Serialize(ofSigStream);
+            m_createdFiles.push_back(sigFile);
+        }
+        const auto newFile { WriteFile(fmt::format("test.batch{}.new", job), updated) };
+        const auto outFile { fmt::format("test.batch{}.delta", job) };
+        m_createdFiles.push_back(outFile);
+        manifest += fmt::format("{} {}\t{}\n", sigFile, newFile, outFile);
+
+        filediff::Delta delta { sigFile, newFile };
+        std::stringstream binary;
+        filediff::BinaryDeltaWriter writer { binary, delta.GetSignatureMetadata() };
+        delta.CalculateInstructions(std::ref(writer));
+        expectedDeltas.push_back(binary.str());
+    }
+    // job with missing signature fails alone //
+    manifest += "test.batch.missing.sig test.batch0.new test.batch.missing.delta\n";
+    const filediff::Batch batch { WriteFile("test.batch.manifest", manifest) };
+    ASSERT_EQ(NUMBER_OF_JOBS + 1, batch.GetJobs().size());
+
+    // budget lets only a couple of jobs in flight at once //
+    filediff::ThreadPool pool { 4 };
+    std::stringstream report;
+    EXPECT_EQ(1U, batch.Run(pool, { true, filediff::Delta::MatchingEngine::INDEXED, 40000 }, report));
+
+    for (auto job { 0U }; job < NUMBER_OF_JOBS; ++job) {
+        EXPECT_EQ(expectedDeltas[job], ReadFile(fmt::format("test.batch{}.delta", job)));
+        EXPECT_NE(std::string::npos, report.str().find(fmt::format("ok test.batch{}.delta\n", job)));
+    }
+    EXPECT_NE(std::string::npos, report.str().find("error test.batch.missing.delta: "));
+    struct stat buffer;
+    EXPECT_NE(0, stat("test.batch.missing.delta", &buffer));
+    EXPECT_NE(0, stat("test.batch.missing.delta.tmp", &buffer));
+}
+
+TEST_F(BatchTestSuite, MalformedManifestLineIsRejectedTest)
+{
+    const auto manifest { WriteFile("test.batch.manifest", "a.sig a.new a.delta\nb.sig b.new\n") };
+    EXPECT_THROW(filediff::Batch { manifest }, std::runtime_error);
+    EXPECT_THROW(filediff::Batch { "test.batch.no.manifest" }, std::runtime_error);
+}
+
+
+class InMemoryTestSuite : public ::testing::TestWithParam<std::pair<filediff::Signature::ChunkingMode, uint32_t>> {
+public:
+    void TearDown() override
+    {
+        std::remove("test.memory.base");
+        std::remove("test.memory.new");
+        std::remove("test.memory.sig");
+    }
+};
+
+TEST_P(InMemoryTestSuite, SameResultAsFilesTest)
+{
+    std::string base, updated;
+    for (auto i { 0U }; i < 5000; ++i) {
+        base += fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 61), i);
+        updated += fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 61), i % 97 == 0 ? i + 1 : i);
+    }
+    std::ofstream { "test.memory.base", std::ios::binary } << base;
+    std::ofstream { "test.memory.new", std::ios::binary } << updated;
+
+    const auto [mode, chunkLength] { GetParam() };
+    const filediff::CdcParameters cdc { filediff::DefaultCdcParameters(chunkLength) };
+    auto calculate = [&](const auto& input) {
+        return mode == filediff::Signature::ChunkingMode::CDC ? filediff::Signature(input, cdc)
+                                                              : filediff::Signature(input, filediff::Signature::InputFileType::BASIS, mode, chunkLength, nullptr, true);
+    };
+    const auto fromFile { calculate(std::string_view { "test.memory.base" }) };
+    const auto fromBuffer { calculate(std::as_bytes(std::span { base })) };
+    std::stringstream fileStream, bufferStream;
+    fromFile.Serialize(fileStream);
+    fromBuffer.Serialize(bufferStream);
+    ASSERT_EQ(fileStream.str(), bufferStream.str());
+    std::ofstream { "test.memory.sig", std::ios::binary } << fileStream.str();
+
+    // signature loaded from a buffer does not refer to it afterwards //
+    auto serialized { bufferStream.str() };
+    const filediff::Signature loaded { std::as_bytes(std::span { serialized }), filediff::Signature::InputFileType::SIGNATURE };
+    std::ranges::fill(serialized, '\0');
+    EXPECT_TRUE(std::ranges::equal(fromFile.GetHashes(), loaded.GetHashes()));
+    EXPECT_TRUE(std::ranges::equal(fromFile.GetStrongHashes(), loaded.GetStrongHashes()));
+
+    filediff::Delta fileDelta { "test.memory.sig", "test.memory.new" };
+    std::stringstream expected;
+    filediff::BinaryDeltaWriter expectedWriter { expected, fileDelta.GetSignatureMetadata() };
+    fileDelta.CalculateInstructions(std::ref(expectedWriter));
+
+    filediff::Delta bufferDelta { loaded, std::as_bytes(std::span { updated }) };
+    std::stringstream delta;
+    filediff::BinaryDeltaWriter writer { delta, bufferDelta.GetSignatureMetadata() };
+    bufferDelta.CalculateInstructions(std::ref(writer));
+    EXPECT_TRUE(bufferDelta.IsChanged());
+    EXPECT_EQ(expected.str(), delta.str());
+}
+
+INSTANTIATE_TEST_SUITE_P(InMemoryTests, InMemoryTestSuite,
+    ::testing::Values(std::pair { filediff::Signature::ChunkingMode::LINE, 1U },
+        std::pair { filediff::Signature::ChunkingMode::BLOCK, 1000U },
+        std::pair { filediff::Signature::ChunkingMode::CDC, 1024U }));
+
+int AppendTo(void* context, const void* data, size_t size)
+{
+    static_cast<std::string*>(context)->append(static_cast<const char*>(data), size);
+    return 0;
+}
+
+TEST(CApiTestSuite, SameOutputAsLibraryTest)
+{
+    std::string base, updated;
+    for (auto i { 0U }; i < 3000; ++i) {
+        base += fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 43), i);
+        updated += fmt::format("{} {}\n", std::string_view { LOREM_IPSUM_STR }.substr(0, i % 43), i % 50 == 0 ? i + 1 : i);
+    }
+    EXPECT_EQ(FILEDIFF_ABI_VERSION, filediff_abi_version());
+
+    const filediff::Signature expectedSignature { std::as_bytes(std::span { base }), filediff::Signature::InputFileType::BASIS,
+        filediff::Signature::ChunkingMode::LINE, 1, nullptr, true };
+    std::stringstream expected;
+    expectedSignature.Serialize(expected);
+
+    filediff_signature* calculated { nullptr };
+    filediff_signature_options signatureOptions {};
+    signatureOptions.strong_hashes = 1;
+    ASSERT_EQ(FILEDIFF_OK, filediff_signature_calculate(base.data(), base.size(), &signatureOptions, &calculated));
+    std::string serialized;
+    ASSERT_EQ(FILEDIFF_OK, filediff_signature_serialize(calculated, AppendTo, &serialized));
+    filediff_signature_free(calculated);
+    EXPECT_EQ(expected.str(), serialized);
+
+    filediff_signature* signature { nullptr };
+    ASSERT_EQ(FILEDIFF_OK, filediff_signature_load(serialized.data(), serialized.size(), &signature));
+
+    // text and binary delta written through callback are the ones the library writes to a stream //
+    filediff::Delta delta { expectedSignature, std::as_bytes(std::span { updated }) };
+    std::stringstream expectedText, expectedBinary;
+    delta.Calculate(filediff::Delta::StreamSink(expectedText));
+    filediff::BinaryDeltaWriter writer { expectedBinary, delta.GetSignatureMetadata() };
+    delta.CalculateInstructions(std::ref(writer));
+
+    std::string text, binary;
+    filediff_delta_options options {};
+    ASSERT_EQ(FILEDIFF_OK, filediff_delta(signature, updated.data(), updated.size(), &options, AppendTo, &text));
+    EXPECT_EQ(expectedText.str(), text);
+    options.format = FILEDIFF_FORMAT_BINARY;
+    ASSERT_EQ(FILEDIFF_OK, filediff_delta(signature, updated.data(), updated.size(), &options, AppendTo, &binary));
+    EXPECT_EQ(expectedBinary.str(), binary);
+
+    std::string rebuilt;
+    auto collect = [](void* context, const filediff_instruction* instruction) {
+        if (instruction->type == FILEDIFF_INSTRUCTION_COPY || instruction->type == FILEDIFF_INSTRUCTION_LITERAL) {
+            static_cast<std::string*>(context)->append(instruction->data, instruction->size);
+        }
+        return 0;
+    };
+    ASSERT_EQ(FILEDIFF_OK, filediff_delta_instructions(signature, updated.data(), updated.size(), nullptr, collect, &rebuilt));
+    EXPECT_EQ(updated, rebuilt);
+
+    // failures come back as status with a reason, nothing is thrown //
+    auto abort = [](void*, const filediff_instruction*) { return 1; };
+    EXPECT_EQ(FILEDIFF_ABORTED, filediff_delta_instructions(signature, updated.data(), updated.size(), nullptr, abort, nullptr));
+    auto refuse = [](void*, const void*, size_t) { return 1; };
+    EXPECT_EQ(FILEDIFF_ABORTED, filediff_delta(signature, updated.data(), updated.size(), nullptr, refuse, nullptr));
+    filediff_signature_free(signature);
+
+    // copies of binary delta shall be verified, line signature without strong hashes is refused //
+    ASSERT_EQ(FILEDIFF_OK, filediff_signature_calculate(base.data(), base.size(), nullptr, &signature));
+    EXPECT_EQ(FILEDIFF_INVALID_ARGUMENT, filediff_delta(signature, updated.data(), updated.size(), &options, AppendTo, &binary));
+    EXPECT_NE(std::string_view { filediff_last_error() }.find("--strong-hash"), std::string_view::npos);
+    filediff_signature_free(signature);
+
+    filediff_signature_options blocks {};
+    blocks.chunking = FILEDIFF_CHUNKING_BLOCK;
+    EXPECT_EQ(FILEDIFF_INVALID_ARGUMENT, filediff_signature_calculate(base.data(), base.size(), &blocks, &signature));
+    EXPECT_NE(std::string_view {}, filediff_last_error());
+    EXPECT_EQ(FILEDIFF_ERROR, filediff_signature_load(base.data(), base.size(), &signature));
+    EXPECT_EQ(FILEDIFF_ERROR, filediff_signature_load_file("test.capi.missing.sig", &signature));
+    EXPECT_EQ(FILEDIFF_OK, filediff_signature_calculate(nullptr, 0, nullptr, &signature));
+    EXPECT_EQ(std::string_view {}, filediff_last_error());
+    filediff_signature_free(signature);
+}
+
+
+class HashTreeTestSuite : public ::testing::TestWithParam<std::pair<uint32_t, bool>> {
+public:
+    void TearDown() override
+    {
+        std::remove("test.tree.sig");
+    }
+
+    // pseudo random content, no two blocks alike
+    static std::string RandomData(size_t size, uint32_t seed)
+    {
+        std::mt19937 generator { seed };
+        std::string data(size, '\0');
+        std::ranges::generate(data, [&generator] { return static_cast<char>(generator()); });
+        return data;
+    }
+};
+
+TEST(HashTreeTestSuite, TreeIsSerializedAndLoadedTest)
+{
+    constexpr uint32_t BLOCK_SIZE { 1000 };
+    const auto base { HashTreeTestSuite::RandomData(100 * BLOCK_SIZE + 10, 1) };
+    filediff::Signature signature { std::as_bytes(std::span { base }), filediff::Signature::InputFileType::BASIS,
+        filediff::Signature::ChunkingMode::BLOCK, BLOCK_SIZE };
+    EXPECT_EQ(0, signature.GetTreeHeight());
+    EXPECT_THROW(signature.AddTree(1), std::invalid_argument);
+    signature.AddTree(4);
+
+    // 101 blocks, 26, 7, 2 and 1 nodes above them //
+    ASSERT_EQ(4, signature.GetTreeHeight());
+    EXPECT_EQ(26, signature.GetTreeLevel(1).size());
+    EXPECT_EQ(1, signature.GetTreeLevel(4).size());
+    EXPECT_TRUE(signature.GetTreeLevel(5).empty());
+    EXPECT_EQ(filediff::TreeNodeHash(signature.GetStrongHashes().subspan(100)), signature.GetTreeLevel(1)[25]);
+    EXPECT_EQ(filediff::TreeNodeHash(signature.GetTreeLevel(1).subspan(4, 4)), signature.GetTreeLevel(2)[1]);
+    EXPECT_EQ(filediff::TreeNodeHash(signature.GetTreeLevel(3)), signature.GetTreeLevel(4)[0]);
+
+    std::stringstream serialized;
+    signature.Serialize(serialized);
+    auto bytes { serialized.str() };
+    EXPECT_EQ(filediff::TREE_SIGNATURE_VERSION, static_cast<uint32_t>(bytes[4]));
+    std::ofstream { "test.tree.sig", std::ios::binary } << bytes;
+    const filediff::Signature loaded { "test.tree.sig", filediff::Signature::InputFileType::SIGNATURE };
+    EXPECT_EQ(4, loaded.GetMetadata().m_treeFanout);
+    for (size_t level { 0 }; level <= signature.GetTreeHeight(); ++level) {
+        EXPECT_TRUE(std::ranges::equal(signature.GetTreeLevel(level), loaded.GetTreeLevel(level)));
+    }
+
+    // tree is covered by checksum //
+    bytes[bytes.size() - 3] ^= 1;
+    EXPECT_THROW(filediff::Signature(std::as_bytes(std::span { bytes }), filediff::Signature::InputFileType::SIGNATURE), std::runtime_error);
+
+    // updated signature keeps the tree //
+    const auto appended { base + HashTreeTestSuite::RandomData(5 * BLOCK_SIZE, 2) };
+    std::ofstream { "test.txt", std::ios::binary } << appended;
+    const filediff::Signature updated { "test.txt", loaded, base.size() };
+    filediff::Signature recalculated { std::as_bytes(std::span { appended }), filediff::Signature::InputFileType::BASIS,
+        filediff::Signature::ChunkingMode::BLOCK, BLOCK_SIZE };
+    recalculated.AddTree(4);
+    ASSERT_EQ(recalculated.GetTreeHeight(), updated.GetTreeHeight());
+    EXPECT_TRUE(std::ranges::equal(recalculated.GetTreeLevel(1), updated.GetTreeLevel(1)));
+    EXPECT_TRUE(std::ranges::equal(recalculated.GetTreeLevel(4), updated.GetTreeLevel(4)));
+
+    filediff::Signature lines { std::as_bytes(std::span { base }), filediff::Signature::InputFileType::BASIS };
+    EXPECT_THROW(lines.AddTree(4), std::invalid_argument);
+}
+
+TEST_P(HashTreeTestSuite, SameDeltaAsWithoutTreeTest)
+{
+    constexpr uint32_t BLOCK_SIZE { 512 };
+    const auto [fanout, parallel] { GetParam() };
+    const auto base { RandomData(3000 * BLOCK_SIZE + 100, 3) };
+    // blocks rewritten in place, bytes inserted (later blocks are found shifted) and a block moved to the end //
+    auto updated { base };
+    for (const auto block : { 5U, 6U, 700U, 1499U, 2100U }) {
+        updated.replace(block * BLOCK_SIZE + 7, 3, "new");
+    }
+    updated.insert(1800 * BLOCK_SIZE + 3, "inserted");
+    updated += base.substr(10 * BLOCK_SIZE, BLOCK_SIZE);
+
+    filediff::Signature plain { std::as_bytes(std::span { base }), filediff::Signature::InputFileType::BASIS,
+        filediff::Signature::ChunkingMode::BLOCK, BLOCK_SIZE };
+    filediff::Signature tree { std::as_bytes(std::span { base }), filediff::Signature::InputFileType::BASIS,
+        filediff::Signature::ChunkingMode::BLOCK, BLOCK_SIZE };
+    tree.AddTree(fanout);
+
+    filediff::ThreadPool pool { 4 };
+    auto calculate = [&](const filediff::Signature& signature) {
+        filediff::Delta delta { signature, std::as_bytes(std::span { updated }) };
+        std::vector<std::tuple<filediff::Delta::Instruction::Type, size_t, std::string_view>> instructions;
+        delta.CalculateInstructions([&instructions](const filediff::Delta::Instruction& instruction) {
+            instructions.emplace_back(instruction.m_type, instruction.m_baseChunk, instruction.m_data);
+        },
+            filediff::Delta::MatchingEngine::INDEXED, parallel ? &pool : nullptr);
+        return instructions;
+    };
+    const auto expected { calculate(plain) };
+    auto& stats { filediff::Stats::Instance() };
+    stats.Reset();
+    EXPECT_EQ(expected, calculate(tree));
+#ifdef FILEDIFF_STATS
+    // everything but a few runs around the changes is confirmed through the tree //
+    EXPECT_LT(2800, stats.Get(filediff::Stats::Counter::TREE_CONFIRMED_BLOCKS));
+#endif
+}
+
+INSTANTIATE_TEST_SUITE_P(HashTreeTests, HashTreeTestSuite,
+    ::testing::Values(std::pair { 2U, false }, std::pair { 2U, true }, std::pair { 16U, false }, std::pair { 16U, true }));
+
 } // testing namespace
@@ -0,0 +1,102 @@
+#include <algorithm>
+
+#include "threadpool.h"
+
+namespace {
+
+// lets tasks submitted from inside a worker go straight to that worker's own queue
+thread_local const filediff::ThreadPool* currentPool { nullptr };
+thread_local unsigned currentWorker { 0 };
+
+} // namespace
+
+filediff::ThreadPool::ThreadPool(unsigned numberOfThreads)
+{
+    numberOfThreads = std::max(numberOfThreads, 1U);
+    for (auto i { 0U }; i < numberOfThreads; ++i) {
+        m_queues.emplace_back(std::make_unique<WorkerQueue>());
+    }
+    for (auto i { 0U }; i < numberOfThreads; ++i) {
+        m_workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+filediff::ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock { m_mutex };
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+unsigned filediff::ThreadPool::Size() const noexcept
+{
+    return static_cast<unsigned>(m_workers.size());
+}
+
+void filediff::ThreadPool::Push(Task task)
+{
+    const auto queue { currentPool == this ? currentWorker : m_nextQueue++ % Size() };
+    {
+        std::lock_guard lock { m_queues[queue]->m_mutex };
+        m_queues[queue]->m_tasks.emplace_back(std::move(task));
+    }
+    {
+        std::lock_guard lock { m_mutex };
+        m_pending++;
+    }
+    m_condition.notify_one();
+}
+
+bool filediff::ThreadPool::TryPop(unsigned worker, Task& task)
+{
+    {
+        auto& own { *m_queues[worker] };
+        std::lock_guard lock { own.m_mutex };
+        if (!own.m_tasks.empty()) {
+            task = std::move(own.m_tasks.back());
+            own.m_tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (auto i { 1U }; i < Size(); ++i) {
+        auto& victim { *m_queues[(worker + i) % Size()] };
+        std::lock_guard lock { victim.m_mutex };
+        if (!victim.m_tasks.empty()) {
+            task = std::move(victim.m_tasks.front());
+            victim.m_tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void filediff::ThreadPool::WorkerLoop(unsigned worker)
+{
+    currentPool = this;
+    currentWorker = worker;
+
+    while (true) {
+        {
+            std::unique_lock lock { m_mutex };
+            m_condition.wait(lock, [this] { return m_pending > 0 || m_stopping; });
+            if (m_pending == 0 && m_stopping) {
+                return;
+            }
+            m_pending--; // claims one task, it is guaranteed to be in one of the queues
+        }
+
+        // every claim is backed by a queued task (tasks are queued before m_pending is raised), so this only spins if
+        // another worker popped "our" task and its own one is still to be taken
+        Task task;
+        while (!TryPop(worker, task)) {
+            std::this_thread::yield();
+        }
+        task();
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace filediff {
+
+// Fixed size work-stealing pool. Every worker owns a task queue: it takes its own work from the back (most recently
+// pushed, still hot in cache) and when it runs dry it steals from the front of other workers' queues.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned numberOfThreads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename Function>
+    auto Submit(Function&& function) -> std::future<std::invoke_result_t<Function>>
+    {
+        auto task { std::make_shared<std::packaged_task<std::invoke_result_t<Function>()>>(std::forward<Function>(function)) };
+        auto future { task->get_future() };
+        Push([task] { (*task)(); });
+        return future;
+    }
+
+    unsigned Size() const noexcept;
+
+private:
+    using Task = std::function<void()>;
+
+    struct WorkerQueue {
+        std::mutex m_mutex;
+        std::deque<Task> m_tasks;
+    };
+
+    void Push(Task task);
+    bool TryPop(unsigned worker, Task& task);
+    void WorkerLoop(unsigned worker);
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<unsigned> m_nextQueue { 0 };
+    std::mutex m_mutex; // guards sleeping, m_pending is changed under it so wakeups are not lost
+    std::condition_variable m_condition;
+    size_t m_pending { 0 };
+    bool m_stopping { false };
+};
+
+} // filediff
+#endif // THREADPOOL_H
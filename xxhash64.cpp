@@ -0,0 +1,91 @@
+#include <bit>
+
+#include "xxhash64.h"
+
+constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+// explicit little-endian loads keep the hash (and so the signature files) identical on every platform
+static uint64_t Read64(const unsigned char* p)
+{
+    uint64_t value = 0;
+    for (auto i = 7; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+static uint32_t Read32(const unsigned char* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint64_t Round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = std::rotl(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t MergeRound(uint64_t acc, uint64_t value)
+{
+    acc ^= Round(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t filediff::xxhash64(std::string_view data, uint64_t seed)
+{
+    auto p = reinterpret_cast<const unsigned char*>(data.data());
+    const auto end = p + data.size();
+    uint64_t h64;
+
+    if (data.size() >= 32) {
+        auto v1 = seed + PRIME64_1 + PRIME64_2;
+        auto v2 = seed + PRIME64_2;
+        auto v3 = seed;
+        auto v4 = seed - PRIME64_1;
+        const auto limit = end - 32;
+        do {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h64 = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+        h64 = MergeRound(h64, v1);
+        h64 = MergeRound(h64, v2);
+        h64 = MergeRound(h64, v3);
+        h64 = MergeRound(h64, v4);
+    } else {
+        h64 = seed + PRIME64_5;
+    }
+
+    h64 += data.size();
+
+    for (; p + 8 <= end; p += 8) {
+        h64 ^= Round(0, Read64(p));
+        h64 = std::rotl(h64, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        h64 ^= static_cast<uint64_t>(Read32(p)) * PRIME64_1;
+        h64 = std::rotl(h64, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h64 ^= (*p) * PRIME64_5;
+        h64 = std::rotl(h64, 11) * PRIME64_1;
+    }
+
+    h64 ^= h64 >> 33;
+    h64 *= PRIME64_2;
+    h64 ^= h64 >> 29;
+    h64 *= PRIME64_3;
+    h64 ^= h64 >> 32;
+
+    return h64;
+}
@@ -0,0 +1,13 @@
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+#include <cstdint>
+#include <string_view>
+
+namespace filediff {
+
+// XXH64 (https://github.com/Cyan4973/xxHash), used as strong hash confirming matches of weak rolling checksum
+uint64_t xxhash64(std::string_view data, uint64_t seed = 0);
+
+} // filediff
+#endif // XXHASH64_H